@@ -1,61 +1,126 @@
 #include <iostream>
+#include <bit>
+#include <cstring>
 #include <vector>
+#include <iterator>
+#include <memory>
+#include <span>
 #include <type_traits>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <stdexcept>
 
 
+// Buckets get about a page worth of elements, rounded down to a power of two
+// so that indexing splits a position into bucket and slot with a shift and a
+// mask.
 template <typename T>
+constexpr size_t default_bucket_length() {
+    return std::bit_floor(std::max<size_t>(4096 / sizeof(T), 1));
+}
+
+
+template <typename T, typename Alloc = std::allocator<T>,
+          size_t BucketLength = default_bucket_length<T>()>
 class Deque {
+    static_assert(std::has_single_bit(BucketLength),
+                  "bucket length must be a power of two");
+
    private:
     template <bool IsConst>
     struct common_iterator;
+    template <bool IsConst>
+    struct common_segments;
+
+    using AllocTraits = typename std::allocator_traits<Alloc>::template rebind_traits<T>;
+    using MapAllocator = typename AllocTraits::template rebind_alloc<T*>;
+    using Map = std::vector<T*, MapAllocator>;
 
    public:
+    using value_type = T;
+    using allocator_type = typename AllocTraits::allocator_type;
     using iterator = common_iterator<false>;
     using const_iterator = common_iterator<true>;
     using reverse_iterator = std::reverse_iterator<iterator>;
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    using segments_range = common_segments<false>;
+    using const_segments_range = common_segments<true>;
 
-    Deque();
-    explicit Deque(int count);
-    Deque(int count, const T& value);
+    Deque() : Deque(allocator_type()) {}
+    explicit Deque(const allocator_type& allocator);
+    explicit Deque(int count, const allocator_type& allocator = allocator_type());
+    Deque(int count, const T& value,
+          const allocator_type& allocator = allocator_type());
+    template <typename InputIt,
+              typename = std::enable_if_t<!std::is_integral<InputIt>::value>>
+    Deque(InputIt first, InputIt last,
+          const allocator_type& allocator = allocator_type());
+    Deque(std::initializer_list<T> values,
+          const allocator_type& allocator = allocator_type());
     Deque(const Deque& deque);
+    Deque(Deque&& deque) noexcept;
     ~Deque();
     Deque& operator=(const Deque& deque);
+    Deque& operator=(Deque&& deque) noexcept(
+        AllocTraits::propagate_on_container_move_assignment::value ||
+        AllocTraits::is_always_equal::value);
+
+    allocator_type get_allocator() const {
+        return _alloc;
+    }
+
     T& operator[](size_t index);
     const T& operator[](size_t index) const;
     T& at(size_t index);
+    const T& at(size_t index) const;
     void push_back(const T& value);
+    void push_back(T&& value);
     void push_front(const T& value);
+    void push_front(T&& value);
+    template <typename... Args>
+    T& emplace_back(Args&&... args);
+    template <typename... Args>
+    T& emplace_front(Args&&... args);
     void pop_back();
     void pop_front();
-    void insert(iterator it, const T& value);
-    void erase(iterator it);
+    template <typename... Args>
+    iterator emplace(const_iterator pos, Args&&... args);
+    iterator insert(const_iterator pos, const T& value);
+    iterator insert(const_iterator pos, T&& value);
+    iterator insert(const_iterator pos, size_t count, const T& value);
+    template <typename InputIt,
+              typename = std::enable_if_t<!std::is_integral<InputIt>::value>>
+    iterator insert(const_iterator pos, InputIt first, InputIt last);
+    iterator insert(const_iterator pos, std::initializer_list<T> values);
+    iterator erase(const_iterator pos);
+    iterator erase(const_iterator first, const_iterator last);
+    void swap(Deque& deque) noexcept;
 
     size_t size() const { return _deque_size; }
 
+    bool empty() const { return _deque_size == 0; }
+
     const_iterator cbegin() const {
         return const_iterator(_first_index, array.begin() + _first_bucket);
     }
 
-    const_iterator cend() const {
-        return const_iterator(_last_index + 1, array.begin() + _last_bucket);
-    }
+    const_iterator cend() const { return cbegin() + _deque_size; }
 
     iterator begin() {
         return iterator(_first_index, array.begin() + _first_bucket);
     }
 
-    iterator end() {
-        return iterator(_last_index + 1, array.begin() + _last_bucket);
-    }
+    iterator end() { return begin() + _deque_size; }
 
-    const_iterator begin() const {
-        return const_iterator(_first_index, array.begin() + _first_bucket);
-    }
+    const_iterator begin() const { return cbegin(); }
 
-    const_iterator end() const {
-        return const_iterator(_last_index + 1, array.begin() + _last_bucket);
-    }
+    const_iterator end() const { return cend(); }
 
     reverse_iterator rbegin() { return reverse_iterator(end()); }
 
@@ -69,359 +134,793 @@ class Deque {
         return const_reverse_iterator(cbegin());
     }
 
+    segments_range segments() {
+        return segments_range(array.begin() + _first_bucket, _first_index,
+                              _deque_size);
+    }
+
+    const_segments_range segments() const {
+        return const_segments_range(array.begin() + _first_bucket,
+                                    _first_index, _deque_size);
+    }
+
    private:
     template <bool IsConst>
     struct common_iterator {
        public:
-        common_iterator(
-            size_t index,
-            std::conditional_t<IsConst, typename std::vector<T*>::const_iterator,
-                             typename std::vector<T*>::iterator>
-                bucket);
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = std::conditional_t<IsConst, const T*, T*>;
+        using reference = std::conditional_t<IsConst, const T&, T&>;
+        using iterator_category = std::random_access_iterator_tag;
+        using bucket_iterator =
+            std::conditional_t<IsConst,
+                               typename Map::const_iterator,
+                               typename Map::iterator>;
 
-        std::conditional_t<IsConst, const T&, T&> operator*() {
-            return *(*(_bucket) + _index);
-        }
+        common_iterator() = default;
+        common_iterator(size_t index, bucket_iterator bucket);
+        common_iterator(const common_iterator<false>& other)
+            : _index(other._index), _bucket(other._bucket) {}
 
-        std::conditional_t<IsConst, const T*, T*> operator->() {
-            return *_bucket + _index;
-        }
+        reference operator*() const { return *(*(_bucket) + _index); }
+
+        pointer operator->() const { return *_bucket + _index; }
+
+        reference operator[](difference_type n) const { return *(*this + n); }
 
         common_iterator<IsConst> operator++(int) &;
         common_iterator<IsConst>& operator++() &;
         common_iterator<IsConst> operator--(int) &;
         common_iterator<IsConst>& operator--() &;
-        common_iterator<IsConst>& operator+=(size_t n);
-        common_iterator<IsConst> operator+(size_t n);
-        common_iterator<IsConst> operator-(size_t n);
+        common_iterator<IsConst>& operator+=(difference_type n);
+        common_iterator<IsConst>& operator-=(difference_type n);
+        common_iterator<IsConst> operator+(difference_type n) const;
+        common_iterator<IsConst> operator-(difference_type n) const;
 
-        size_t operator-(const common_iterator<IsConst>& rhs) {
-            return (_bucket - rhs._bucket) * BUCKET_LENGTH + _index -
-                   rhs._index;
+        difference_type operator-(const common_iterator<IsConst>& rhs) const {
+            return (_bucket - rhs._bucket) *
+                       static_cast<difference_type>(BUCKET_LENGTH) +
+                   static_cast<difference_type>(_index) -
+                   static_cast<difference_type>(rhs._index);
         }
 
-        bool operator==(const common_iterator<IsConst>& rhs) {
+        bool operator==(const common_iterator<IsConst>& rhs) const {
             return _index == rhs._index && _bucket == rhs._bucket;
         }
 
-        bool operator!=(const common_iterator<IsConst>& rhs) {
-            return !(_index == rhs._index && _bucket == rhs._bucket);
+        bool operator!=(const common_iterator<IsConst>& rhs) const {
+            return !(*this == rhs);
         }
 
-        bool operator>(const common_iterator<IsConst>& rhs);
-        bool operator<(const common_iterator<IsConst>& rhs);
+        bool operator>(const common_iterator<IsConst>& rhs) const;
+        bool operator<(const common_iterator<IsConst>& rhs) const;
+
+        bool operator<=(const common_iterator<IsConst>& rhs) const {
+            return !(*this > rhs);
+        }
 
-        bool operator<=(const common_iterator<IsConst>& rhs) {
-            return (*this < rhs) || (*this == rhs);
+        bool operator>=(const common_iterator<IsConst>& rhs) const {
+            return !(*this < rhs);
         }
 
-        bool operator>=(const common_iterator<IsConst>& rhs) {
-            return (*this > rhs) || (*this == rhs);
+        friend common_iterator<IsConst> operator+(difference_type n,
+                                                  const common_iterator& it) {
+            return it + n;
         }
 
        private:
-        size_t _index;
-        std::conditional_t<IsConst, typename std::vector<T*>::const_iterator,
-                         typename std::vector<T*>::iterator>
-            _bucket;
+        friend class Deque;
+        friend struct common_iterator<!IsConst>;
+
+        size_t _index = 0;
+        bucket_iterator _bucket;
+    };
+
+    // The elements as a forward range of spans, one per bucket, so that loops
+    // over a deque run on plain pointers without a bucket check per element.
+    template <bool IsConst>
+    struct common_segments {
+       public:
+        using bucket_iterator =
+            typename common_iterator<IsConst>::bucket_iterator;
+        using span_type = std::span<std::conditional_t<IsConst, const T, T>>;
+
+        struct segment_iterator {
+           public:
+            using difference_type = std::ptrdiff_t;
+            using value_type = span_type;
+            using pointer = void;
+            using reference = span_type;
+            using iterator_category = std::forward_iterator_tag;
+
+            segment_iterator() = default;
+            segment_iterator(bucket_iterator bucket, size_t index,
+                             size_t remaining)
+                : _bucket(bucket), _index(index), _remaining(remaining) {}
+
+            span_type operator*() const {
+                return span_type(*_bucket + _index, _length());
+            }
+
+            segment_iterator& operator++() {
+                _remaining -= _length();
+                _index = 0;
+                ++_bucket;
+                return *this;
+            }
+
+            segment_iterator operator++(int) {
+                segment_iterator it = *this;
+                ++*this;
+                return it;
+            }
+
+            bool operator==(const segment_iterator& rhs) const {
+                return _remaining == rhs._remaining;
+            }
+
+            bool operator!=(const segment_iterator& rhs) const {
+                return !(*this == rhs);
+            }
+
+           private:
+            size_t _length() const {
+                return std::min(BUCKET_LENGTH - _index, _remaining);
+            }
+
+            bucket_iterator _bucket;
+            size_t _index = 0;
+            size_t _remaining = 0;
+        };
+
+        common_segments(bucket_iterator bucket, size_t index, size_t size)
+            : _begin(bucket, index, size), _end(bucket, index, 0) {}
+
+        segment_iterator begin() const { return _begin; }
+
+        segment_iterator end() const { return _end; }
+
+       private:
+        segment_iterator _begin;
+        segment_iterator _end;
     };
 
-    static const int BUCKET_LENGTH = 16;
+    static constexpr size_t BUCKET_LENGTH = BucketLength;
+    static constexpr size_t BUCKET_SHIFT = std::countr_zero(BucketLength);
+    static constexpr size_t BUCKET_MASK = BucketLength - 1;
+    allocator_type _alloc;
     size_t _deque_size = 0;
-    size_t _capacity = BUCKET_LENGTH;
-    std::vector<T*> array;
+    Map array;
+    Map _spare_buckets;
 
     size_t _first_bucket = 0;
-    size_t _last_bucket = 0;
     size_t _first_index = 0;
-    size_t _last_index = BUCKET_LENGTH - 1;
 
+    size_t _used_buckets() const;
     void _grow_buffer();
+    void _allocate_buckets(size_t count);
+    void _release();
+    T* _take_bucket();
+    void _return_bucket(size_t bucket);
+    template <typename Constructor>
+    void _bulk_construct(size_t count, Constructor construct);
+    template <typename Push>
+    iterator _insert_pushed(size_t index, Push push);
+    static void _move_forward(iterator first, iterator last, iterator dest);
+    static void _move_backward(iterator first, iterator last, iterator dest_last);
+    T* _allocate_bucket();
+    void _deallocate_bucket(T* bucket);
 };
 
-template <typename T>
-Deque<T>::Deque() {
-    T* new_sub_array =
-        reinterpret_cast<T*>(new uint8_t[BUCKET_LENGTH * sizeof(T)]);
-    array.push_back(new_sub_array);
-}
-
-template <typename T>
-Deque<T>::Deque(int count) : Deque() {
-    for (size_t i = 0; i < static_cast<size_t>(count); ++i) {
-        push_back(T());
-    }
+// Buckets, the bucket map and the elements all come from the deque's
+// allocator: buckets are allocated as arrays of BUCKET_LENGTH elements, the
+// map uses a copy rebound to T*, and elements are built with
+// allocator_traits::construct.
+template <typename T, typename Alloc, size_t BucketLength>
+Deque<T, Alloc, BucketLength>::Deque(const allocator_type& allocator)
+    : _alloc(allocator),
+      array(1, nullptr, MapAllocator(_alloc)),
+      _spare_buckets(MapAllocator(_alloc)),
+      _first_index(BUCKET_LENGTH / 2) {
+    _spare_buckets.reserve(1);
 }
 
-template <typename T>
-Deque<T>::Deque(int count, const T& value) : Deque() {
-    for (size_t i = 0; i < static_cast<size_t>(count); ++i) {
-        push_back(value);
-    }
+template <typename T, typename Alloc, size_t BucketLength>
+Deque<T, Alloc, BucketLength>::Deque(int count,
+                                     const allocator_type& allocator)
+    : _alloc(allocator),
+      array(MapAllocator(_alloc)),
+      _spare_buckets(MapAllocator(_alloc)) {
+    _bulk_construct(count, [this](T* place) {
+        AllocTraits::construct(_alloc, place);
+    });
 }
 
-template <typename T>
-Deque<T>::Deque(const Deque& deque) {
-    *this = deque;
+template <typename T, typename Alloc, size_t BucketLength>
+Deque<T, Alloc, BucketLength>::Deque(int count, const T& value,
+                                     const allocator_type& allocator)
+    : _alloc(allocator),
+      array(MapAllocator(_alloc)),
+      _spare_buckets(MapAllocator(_alloc)) {
+    _bulk_construct(count, [this, &value](T* place) {
+        AllocTraits::construct(_alloc, place, value);
+    });
 }
 
-template <typename T>
-Deque<T>::~Deque() {
-    for (size_t i = 0; i < _deque_size; ++i) {
-        pop_back();
-    }
-    for (size_t i = 0; i < array.size(); ++i) {
-        delete[] reinterpret_cast<uint8_t*>(array[i]);
+template <typename T, typename Alloc, size_t BucketLength>
+template <typename InputIt, typename>
+Deque<T, Alloc, BucketLength>::Deque(InputIt first, InputIt last,
+                                     const allocator_type& allocator)
+    : _alloc(allocator),
+      array(MapAllocator(_alloc)),
+      _spare_buckets(MapAllocator(_alloc)) {
+    using category = typename std::iterator_traits<InputIt>::iterator_category;
+    if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value) {
+        _bulk_construct(std::distance(first, last), [this, &first](T* place) {
+            AllocTraits::construct(_alloc, place, *first);
+            ++first;
+        });
+    } else {
+        array.push_back(nullptr);
+        _spare_buckets.reserve(1);
+        _first_index = BUCKET_LENGTH / 2;
+        try {
+            for (; first != last; ++first) {
+                emplace_back(*first);
+            }
+        } catch (...) {
+            _release();
+            throw;
+        }
     }
 }
 
-template <typename T>
-Deque<T>& Deque<T>::operator=(const Deque& deque) {
-    if (array == deque.array) return *this;
+template <typename T, typename Alloc, size_t BucketLength>
+Deque<T, Alloc, BucketLength>::Deque(std::initializer_list<T> values,
+                                     const allocator_type& allocator)
+    : Deque(values.begin(), values.end(), allocator) {}
 
-    size_t cur_size = _deque_size;
-    for (size_t i = 0; i < cur_size; ++i) {
-        pop_back();
-    }
-    for (size_t i = 0; i < array.size(); ++i) {
-        delete[] reinterpret_cast<uint8_t*>(array[i]);
-    }
-    array.clear();
+template <typename T, typename Alloc, size_t BucketLength>
+Deque<T, Alloc, BucketLength>::Deque(const Deque& deque)
+    : Deque(deque.begin(), deque.end(),
+            AllocTraits::select_on_container_copy_construction(deque._alloc)) {}
 
-    _deque_size = deque._deque_size;
-    array.resize(deque.array.size());
-    _capacity = deque._capacity;
-    _first_index = deque._first_index;
-    _first_bucket = deque._first_bucket;
-    _last_index = deque._last_index;
-    _last_bucket = deque._last_bucket;
+template <typename T, typename Alloc, size_t BucketLength>
+Deque<T, Alloc, BucketLength>::Deque(Deque&& deque) noexcept
+    : _alloc(std::move(deque._alloc)),
+      _deque_size(deque._deque_size),
+      array(std::move(deque.array)),
+      _spare_buckets(std::move(deque._spare_buckets)),
+      _first_bucket(deque._first_bucket),
+      _first_index(deque._first_index) {
+    deque.array.clear();
+    deque._spare_buckets.clear();
+    deque._deque_size = 0;
+    deque._first_bucket = 0;
+    deque._first_index = 0;
+}
 
-    for (size_t i = 0; i < array.size(); ++i) {
-        T* new_bucket =
-            reinterpret_cast<T*>(new uint8_t[BUCKET_LENGTH * sizeof(T)]);
-        array[i] = new_bucket;
-    }
+template <typename T, typename Alloc, size_t BucketLength>
+Deque<T, Alloc, BucketLength>::~Deque() {
+    _release();
+}
 
-    for (size_t i = _first_index; i < BUCKET_LENGTH; ++i) {
-        try {
-            new (array[_first_bucket] + i) T(deque.array[_first_bucket][i]);
-        } catch (...) {
-            for (size_t j = 0; j < i; ++j) {
-                (array[_first_bucket + i])->~T();
-            }
-            throw;
-        }
-    }
-    for (size_t add_element = 0; add_element <= _last_index; ++add_element) {
-        try {
-            new (array[_last_bucket]+add_element)
-									T(deque.array[_last_bucket][add_element]);
-        } catch (...) {
-            for (size_t del_element = 0;
-            		del_element < add_element; ++del_element) {
-                (array[_last_bucket + del_element])->~T();
-            }
-            throw;
-        }
+template <typename T, typename Alloc, size_t BucketLength>
+Deque<T, Alloc, BucketLength>& Deque<T, Alloc, BucketLength>::operator=(const Deque& deque) {
+    if (this != &deque) {
+        Deque copy(deque.begin(), deque.end(),
+                   AllocTraits::propagate_on_container_copy_assignment::value
+                       ? deque._alloc
+                       : _alloc);
+        swap(copy);
     }
-    if (_last_bucket) {
-        for (size_t bucket = _first_bucket + 1; bucket <= _last_bucket - 1;
-             ++bucket) {
-            for (size_t add_element = 0;
-            		add_element < BUCKET_LENGTH; ++add_element) {
-                try {
-                    new (array[bucket]+add_element)
-                    	T(deque.array[bucket][add_element]);
-                } catch (...) {
-                    for (size_t del_bucket = _first_bucket + 1;
-                    		del_bucket < bucket; ++del_bucket) {
-                        for (size_t del_element = 0;
-                        		del_element < BUCKET_LENGTH; ++del_element) {
-                            (array[del_bucket]+del_element)->~T();
-                        }
-                    }
-                    for (size_t del_element = 0;
-                    		del_element < add_element; ++del_element) {
-                        (array[bucket]+del_element)->~T();
-                    }
-                    for (size_t i = 0; i < array.size(); ++i) {
-                        delete[] reinterpret_cast<uint8_t*>(array[i]);
-                    }
-                    throw;
-                }
-            }
+    return *this;
+}
+
+// Without allocator propagation the buckets of another deque can only be
+// taken over when both allocators can free each other's memory; otherwise
+// the elements are moved one by one into buckets of our own allocator.
+template <typename T, typename Alloc, size_t BucketLength>
+Deque<T, Alloc, BucketLength>& Deque<T, Alloc, BucketLength>::operator=(
+    Deque&& deque) noexcept(AllocTraits::propagate_on_container_move_assignment::
+                                value ||
+                            AllocTraits::is_always_equal::value) {
+    if constexpr (!AllocTraits::propagate_on_container_move_assignment::value &&
+                  !AllocTraits::is_always_equal::value) {
+        if (_alloc != deque._alloc) {
+            Deque moved(std::make_move_iterator(deque.begin()),
+                        std::make_move_iterator(deque.end()), _alloc);
+            swap(moved);
+            return *this;
         }
     }
+    Deque moved(std::move(deque));
+    swap(moved);
     return *this;
 }
 
-template <typename T>
-T& Deque<T>::operator[](size_t index) {
+template <typename T, typename Alloc, size_t BucketLength>
+T& Deque<T, Alloc, BucketLength>::operator[](size_t index) {
     size_t new_index = _first_index + index;
-    size_t new_bucket = (_first_bucket + new_index / BUCKET_LENGTH);
-    return array[new_bucket][new_index % BUCKET_LENGTH];
+    size_t new_bucket = (_first_bucket + (new_index >> BUCKET_SHIFT));
+    return array[new_bucket][new_index & BUCKET_MASK];
 }
 
-template <typename T>
-const T& Deque<T>::operator[](size_t index) const {
+template <typename T, typename Alloc, size_t BucketLength>
+const T& Deque<T, Alloc, BucketLength>::operator[](size_t index) const {
     size_t new_index = _first_index + index;
-    size_t new_bucket = (_first_bucket + new_index / BUCKET_LENGTH);
-    return array[new_bucket][new_index % BUCKET_LENGTH];
+    size_t new_bucket = (_first_bucket + (new_index >> BUCKET_SHIFT));
+    return array[new_bucket][new_index & BUCKET_MASK];
 }
 
-template <typename T>
-T& Deque<T>::at(size_t index) {
-    size_t new_index = _first_index + index;
-    if (index < 0 || new_index >= _deque_size) {
+template <typename T, typename Alloc, size_t BucketLength>
+T& Deque<T, Alloc, BucketLength>::at(size_t index) {
+    if (index >= _deque_size) {
         throw std::out_of_range("out of range");
     }
     return (*this)[index];
 }
 
-template <typename T>
-void Deque<T>::push_back(const T& value) {
-    if (_last_index == BUCKET_LENGTH - 1) {
-        if (_last_bucket == array.size() - 1) {
-            _grow_buffer();
-        }
-        _last_index = 0;
-        if (_deque_size) {
-            ++_last_bucket;
+template <typename T, typename Alloc, size_t BucketLength>
+const T& Deque<T, Alloc, BucketLength>::at(size_t index) const {
+    if (index >= _deque_size) {
+        throw std::out_of_range("out of range");
+    }
+    return (*this)[index];
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::push_back(const T& value) {
+    emplace_back(value);
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::push_back(T&& value) {
+    emplace_back(std::move(value));
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::push_front(const T& value) {
+    emplace_front(value);
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::push_front(T&& value) {
+    emplace_front(std::move(value));
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+template <typename... Args>
+T& Deque<T, Alloc, BucketLength>::emplace_back(Args&&... args) {
+    size_t last_index = _first_index + _deque_size;
+    if (_first_bucket + (last_index >> BUCKET_SHIFT) >= array.size()) {
+        _grow_buffer();
+    }
+    size_t bucket = _first_bucket + (last_index >> BUCKET_SHIFT);
+    bool new_bucket = array[bucket] == nullptr;
+    if (new_bucket) {
+        array[bucket] = _take_bucket();
+    }
+    T* place = array[bucket] + (last_index & BUCKET_MASK);
+    try {
+        AllocTraits::construct(_alloc, place, std::forward<Args>(args)...);
+    } catch (...) {
+        if (new_bucket) {
+            _return_bucket(bucket);
         }
-    } else {
-        ++_last_index;
+        throw;
     }
-    new (array[_last_bucket] + _last_index) T(value);
     ++_deque_size;
+    return *place;
 }
 
-template <typename T>
-void Deque<T>::push_front(const T& value) {
-    if (_first_index == 0) {
-        if (_first_bucket == 0) {
-            _grow_buffer();
-        }
-        _first_index = BUCKET_LENGTH - 1;
-        if (_deque_size) {
-            --_first_bucket;
+template <typename T, typename Alloc, size_t BucketLength>
+template <typename... Args>
+T& Deque<T, Alloc, BucketLength>::emplace_front(Args&&... args) {
+    if (_first_index == 0 && _first_bucket == 0) {
+        _grow_buffer();
+    }
+    size_t bucket = _first_index == 0 ? _first_bucket - 1 : _first_bucket;
+    size_t index = _first_index == 0 ? BUCKET_LENGTH - 1 : _first_index - 1;
+    bool new_bucket = array[bucket] == nullptr;
+    if (new_bucket) {
+        array[bucket] = _take_bucket();
+    }
+    T* place = array[bucket] + index;
+    try {
+        AllocTraits::construct(_alloc, place, std::forward<Args>(args)...);
+    } catch (...) {
+        if (new_bucket) {
+            _return_bucket(bucket);
         }
-    } else {
-        --_first_index;
+        throw;
     }
-    new (array[_first_bucket] + _first_index) T(value);
+    _first_bucket = bucket;
+    _first_index = index;
     ++_deque_size;
+    return *place;
 }
 
-template <typename T>
-void Deque<T>::pop_back() {
-    (array[_last_bucket] + _last_index)->~T();
-    if (_last_index == 0) {
-        _last_index = BUCKET_LENGTH - 1;
-        --_last_bucket;
-    } else {
-        --_last_index;
-    }
+// A bucket goes back to the spare list as soon as its last element is
+// popped, and an emptied deque restarts from the middle of its map.
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::pop_back() {
+    size_t last_index = _first_index + _deque_size - 1;
+    size_t bucket = _first_bucket + (last_index >> BUCKET_SHIFT);
+    AllocTraits::destroy(_alloc, array[bucket] + (last_index & BUCKET_MASK));
     --_deque_size;
-    if (_deque_size < 0) throw;
+    if (_deque_size == 0 || (last_index & BUCKET_MASK) == 0) {
+        _return_bucket(bucket);
+    }
+    if (_deque_size == 0) {
+        _first_bucket = array.size() / 2;
+        _first_index = BUCKET_LENGTH / 2;
+    }
 }
 
-template <typename T>
-void Deque<T>::pop_front() {
-    (array[_first_bucket] + _first_index)->~T();
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::pop_front() {
+    size_t bucket = _first_bucket;
+    AllocTraits::destroy(_alloc, array[_first_bucket] + _first_index);
     if ((++_first_index) == BUCKET_LENGTH) {
         _first_index = 0;
         ++_first_bucket;
     }
     --_deque_size;
-    if (_deque_size < 0) throw;
+    if (_deque_size == 0 || _first_bucket != bucket) {
+        _return_bucket(bucket);
+    }
+    if (_deque_size == 0) {
+        _first_bucket = array.size() / 2;
+        _first_index = BUCKET_LENGTH / 2;
+    }
 }
 
-template <typename T>
-void Deque<T>::insert(iterator it, const T& value) {
-    push_back((*this)[_deque_size - 1]);
-    for (iterator i = end() - 2; i > it; --i) {
-        *i = *(i - 1);
+// Middle edits shift whichever side of the position is shorter, so they cost
+// O(min(i, n - i)) moves.
+template <typename T, typename Alloc, size_t BucketLength>
+template <typename... Args>
+typename Deque<T, Alloc, BucketLength>::iterator
+Deque<T, Alloc, BucketLength>::emplace(const_iterator pos, Args&&... args) {
+    size_t index = pos - cbegin();
+    if (index == _deque_size) {
+        emplace_back(std::forward<Args>(args)...);
+        return end() - 1;
+    }
+    if (index == 0) {
+        emplace_front(std::forward<Args>(args)...);
+        return begin();
     }
-    *it = value;
+    T value(std::forward<Args>(args)...);
+    if (index < _deque_size - index) {
+        emplace_front(std::move((*this)[0]));
+        _move_forward(begin() + 2, begin() + index + 1, begin() + 1);
+    } else {
+        emplace_back(std::move((*this)[_deque_size - 1]));
+        _move_backward(begin() + index, end() - 2, end() - 1);
+    }
+    (*this)[index] = std::move(value);
+    return begin() + index;
 }
 
-template <typename T>
-void Deque<T>::erase(iterator it) {
-    for (iterator i = it; i < end() - 1; ++i) {
-        *i = *(i + 1);
+template <typename T, typename Alloc, size_t BucketLength>
+typename Deque<T, Alloc, BucketLength>::iterator
+Deque<T, Alloc, BucketLength>::insert(const_iterator pos, const T& value) {
+    return emplace(pos, value);
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+typename Deque<T, Alloc, BucketLength>::iterator
+Deque<T, Alloc, BucketLength>::insert(const_iterator pos, T&& value) {
+    return emplace(pos, std::move(value));
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+typename Deque<T, Alloc, BucketLength>::iterator
+Deque<T, Alloc, BucketLength>::insert(const_iterator pos, size_t count,
+                               const T& value) {
+    return _insert_pushed(pos - cbegin(), [&](bool front) {
+        for (size_t i = 0; i < count; ++i) {
+            front ? emplace_front(value) : emplace_back(value);
+        }
+    });
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+template <typename InputIt, typename>
+typename Deque<T, Alloc, BucketLength>::iterator
+Deque<T, Alloc, BucketLength>::insert(const_iterator pos, InputIt first,
+                               InputIt last) {
+    return _insert_pushed(pos - cbegin(), [&](bool front) {
+        for (; first != last; ++first) {
+            front ? emplace_front(*first) : emplace_back(*first);
+        }
+    });
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+typename Deque<T, Alloc, BucketLength>::iterator
+Deque<T, Alloc, BucketLength>::insert(const_iterator pos,
+                               std::initializer_list<T> values) {
+    return insert(pos, values.begin(), values.end());
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+typename Deque<T, Alloc, BucketLength>::iterator
+Deque<T, Alloc, BucketLength>::erase(const_iterator pos) {
+    return erase(pos, pos + 1);
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+typename Deque<T, Alloc, BucketLength>::iterator
+Deque<T, Alloc, BucketLength>::erase(const_iterator first, const_iterator last) {
+    size_t index = first - cbegin();
+    size_t count = last - first;
+    if (count == 0) {
+        return begin() + index;
+    }
+    if (index < _deque_size - index - count) {
+        _move_backward(begin(), begin() + index, begin() + index + count);
+        for (size_t i = 0; i < count; ++i) {
+            pop_front();
+        }
+    } else {
+        _move_forward(begin() + index + count, end(), begin() + index);
+        for (size_t i = 0; i < count; ++i) {
+            pop_back();
+        }
     }
-    pop_back();
+    return begin() + index;
 }
 
-template <typename T>
-void Deque<T>::_grow_buffer() {
-    std::vector<T*> new_array(array.size() * 2);
-    size_t index = array.size() / 2;
-    for (size_t i = 0; i < index; ++i) {
-        new_array[i] =
-            reinterpret_cast<T*>(new uint8_t[BUCKET_LENGTH * sizeof(T)]);
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::swap(Deque& deque) noexcept {
+    std::swap(_alloc, deque._alloc);
+    std::swap(_deque_size, deque._deque_size);
+    array.swap(deque.array);
+    _spare_buckets.swap(deque._spare_buckets);
+    std::swap(_first_bucket, deque._first_bucket);
+    std::swap(_first_index, deque._first_index);
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+size_t Deque<T, Alloc, BucketLength>::_used_buckets() const {
+    if (_deque_size == 0) return 0;
+    return ((_first_index + _deque_size - 1) >> BUCKET_SHIFT) + 1;
+}
+
+// Called when one end of the map is exhausted. Map slots outside the used
+// buckets hold no memory, so while at most half of the map is in use the
+// used buckets are just slid back to its middle, like the head and tail of
+// a ring buffer; queue-like traffic then runs in a map of fixed size.
+// Otherwise the map doubles. Either way both ends get a free slot.
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::_grow_buffer() {
+    size_t used = _used_buckets();
+    auto used_begin = array.begin() + _first_bucket;
+    if (2 * used + 2 <= array.size()) {
+        size_t index = (array.size() - used) / 2;
+        if (index < _first_bucket) {
+            std::copy(used_begin, used_begin + used, array.begin() + index);
+        } else {
+            std::copy_backward(used_begin, used_begin + used,
+                               array.begin() + index + used);
+        }
+        std::fill(array.begin(), array.begin() + index, nullptr);
+        std::fill(array.begin() + index + used, array.end(), nullptr);
+        _first_bucket = index;
+        return;
+    }
+
+    Map new_array(array.size() * 2 + 2, nullptr, array.get_allocator());
+    _spare_buckets.reserve(new_array.size() / 2);
+    size_t index = (new_array.size() - used) / 2;
+    std::copy(used_begin, used_begin + used, new_array.begin() + index);
+    _first_bucket = index;
+    array.swap(new_array);
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::_allocate_buckets(size_t count) {
+    size_t buckets = (count + BUCKET_LENGTH - 1) >> BUCKET_SHIFT;
+    array.assign(std::max<size_t>(buckets, 1), nullptr);
+    _spare_buckets.reserve(std::max<size_t>(array.size() / 2, 1));
+    try {
+        for (size_t i = 0; i < buckets; ++i) {
+            array[i] = _allocate_bucket();
+        }
+    } catch (...) {
+        _release();
+        throw;
     }
-    for (size_t i = index + array.size(); i < new_array.size(); ++i) {
-        new_array[i] =
-            reinterpret_cast<T*>(new uint8_t[BUCKET_LENGTH * sizeof(T)]);
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::_release() {
+    if constexpr (!std::is_trivially_destructible<T>::value) {
+        for (iterator it = begin(); it != end(); ++it) {
+            AllocTraits::destroy(_alloc, &*it);
+        }
+    }
+    for (size_t i = 0; i < array.size(); ++i) {
+        if (array[i] != nullptr) {
+            _deallocate_bucket(array[i]);
+        }
     }
-    for (size_t i = index; i < index + array.size(); ++i) {
-        new_array[i] = array[i - index];
+    for (size_t i = 0; i < _spare_buckets.size(); ++i) {
+        _deallocate_bucket(_spare_buckets[i]);
     }
-    _first_bucket += array.size() / 2;
-    _last_bucket += array.size() / 2;
-    array = new_array;
-    _capacity *= 2;
+    array.clear();
+    _spare_buckets.clear();
+    _deque_size = 0;
 }
 
-template <typename T>
+template <typename T, typename Alloc, size_t BucketLength>
+T* Deque<T, Alloc, BucketLength>::_take_bucket() {
+    if (_spare_buckets.empty()) {
+        return _allocate_bucket();
+    }
+    T* bucket = _spare_buckets.back();
+    _spare_buckets.pop_back();
+    return bucket;
+}
+
+// The spare list never outgrows the capacity reserved for it along with the
+// map, so returning a bucket cannot throw and idle memory stays bounded by
+// half of the deque's peak size. Every map reserves room for at least one
+// spare, so a queue that keeps draining to empty reuses its last bucket.
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::_return_bucket(size_t bucket) {
+    if (_spare_buckets.size() < _spare_buckets.capacity()) {
+        _spare_buckets.push_back(array[bucket]);
+    } else {
+        _deallocate_bucket(array[bucket]);
+    }
+    array[bucket] = nullptr;
+}
+
+// Constructs count elements bucket by bucket, walking plain pointers within
+// each bucket instead of stepping through deque iterators. The size grows
+// with every element, so a throwing construct leaves exactly the built
+// elements for _release to destroy.
+template <typename T, typename Alloc, size_t BucketLength>
+template <typename Constructor>
+void Deque<T, Alloc, BucketLength>::_bulk_construct(size_t count, Constructor construct) {
+    _allocate_buckets(count);
+    try {
+        for (size_t bucket = 0; _deque_size < count; ++bucket) {
+            T* place = array[bucket];
+            T* bucket_end =
+                place + std::min<size_t>(BUCKET_LENGTH, count - _deque_size);
+            for (; place != bucket_end; ++place) {
+                construct(place);
+                ++_deque_size;
+            }
+        }
+    } catch (...) {
+        _release();
+        throw;
+    }
+}
+
+// Range inserts push the new elements onto the end nearer to the position
+// and rotate them into place, which costs O(k + min(i, n - i)) for k new
+// elements and works for single-pass input. A throwing element rolls the
+// deque back to its old contents.
+template <typename T, typename Alloc, size_t BucketLength>
+template <typename Push>
+typename Deque<T, Alloc, BucketLength>::iterator
+Deque<T, Alloc, BucketLength>::_insert_pushed(size_t index, Push push) {
+    size_t old_size = _deque_size;
+    bool front = index < old_size - index;
+    try {
+        push(front);
+    } catch (...) {
+        while (_deque_size > old_size) {
+            front ? pop_front() : pop_back();
+        }
+        throw;
+    }
+    size_t count = _deque_size - old_size;
+    if (front) {
+        std::reverse(begin(), begin() + count);
+        std::rotate(begin(), begin() + count, begin() + count + index);
+    } else {
+        std::rotate(begin() + index, begin() + old_size, end());
+    }
+    return begin() + index;
+}
+
+// std::move and std::move_backward over deque iterators, except that
+// trivially copyable elements are moved a contiguous run at a time, a run
+// ending wherever the source or the destination crosses a bucket boundary.
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::_move_forward(iterator first, iterator last,
+                                           iterator dest) {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        size_t count = last - first;
+        while (count > 0) {
+            size_t run = std::min({count, BUCKET_LENGTH - first._index,
+                                   BUCKET_LENGTH - dest._index});
+            std::memmove(&*dest, &*first, run * sizeof(T));
+            first += run;
+            dest += run;
+            count -= run;
+        }
+    } else {
+        std::move(first, last, dest);
+    }
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::_move_backward(iterator first, iterator last,
+                                            iterator dest_last) {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        size_t count = last - first;
+        while (count > 0) {
+            size_t run = std::min(
+                {count, last._index == 0 ? BUCKET_LENGTH : last._index,
+                 dest_last._index == 0 ? BUCKET_LENGTH : dest_last._index});
+            last -= run;
+            dest_last -= run;
+            std::memmove(&*dest_last, &*last, run * sizeof(T));
+            count -= run;
+        }
+    } else {
+        std::move_backward(first, last, dest_last);
+    }
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+T* Deque<T, Alloc, BucketLength>::_allocate_bucket() {
+    return AllocTraits::allocate(_alloc, BUCKET_LENGTH);
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+void Deque<T, Alloc, BucketLength>::_deallocate_bucket(T* bucket) {
+    AllocTraits::deallocate(_alloc, bucket, BUCKET_LENGTH);
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
 template <bool IsConst>
-Deque<T>::template common_iterator<IsConst>::common_iterator(
-    size_t index,
-    std::conditional_t<IsConst, typename std::vector<T*>::const_iterator,
-                     typename std::vector<T*>::iterator>
-        bucket)
+Deque<T, Alloc, BucketLength>::template common_iterator<IsConst>::common_iterator(
+    size_t index, bucket_iterator bucket)
     : _index(index), _bucket(bucket) {}
 
-template <typename T>
+template <typename T, typename Alloc, size_t BucketLength>
 template <bool IsConst>
-typename Deque<T>::template common_iterator<IsConst>
-    Deque<T>::common_iterator<IsConst>::operator++(int) & {
+typename Deque<T, Alloc, BucketLength>::template common_iterator<IsConst>
+    Deque<T, Alloc, BucketLength>::common_iterator<IsConst>::operator++(int) & {
     common_iterator<IsConst> it(_index, _bucket);
-    ++_index;
-    _bucket += _index / BUCKET_LENGTH;
-    _index %= BUCKET_LENGTH;
+    ++*this;
     return it;
 }
 
-template <typename T>
+template <typename T, typename Alloc, size_t BucketLength>
 template <bool IsConst>
-typename Deque<T>::template common_iterator<IsConst>&
-    Deque<T>::common_iterator<IsConst>::operator++() & {
-    ++_index;
-    _bucket += _index / BUCKET_LENGTH;
-    _index %= BUCKET_LENGTH;
+typename Deque<T, Alloc, BucketLength>::template common_iterator<IsConst>&
+    Deque<T, Alloc, BucketLength>::common_iterator<IsConst>::operator++() & {
+    if (++_index == BUCKET_LENGTH) {
+        _index = 0;
+        ++_bucket;
+    }
     return *this;
 }
 
-template <typename T>
+template <typename T, typename Alloc, size_t BucketLength>
 template <bool IsConst>
-typename Deque<T>::template common_iterator<IsConst>
-    Deque<T>::common_iterator<IsConst>::operator--(int) & {
+typename Deque<T, Alloc, BucketLength>::template common_iterator<IsConst>
+    Deque<T, Alloc, BucketLength>::common_iterator<IsConst>::operator--(int) & {
     common_iterator<IsConst> it(_index, _bucket);
-    if (_index == 0) {
-        _index = BUCKET_LENGTH - 1;
-        --_bucket;
-    } else {
-        --_index;
-    }
+    --*this;
     return it;
 }
 
-template <typename T>
+template <typename T, typename Alloc, size_t BucketLength>
 template <bool IsConst>
-typename Deque<T>::template common_iterator<IsConst>&
-    Deque<T>::common_iterator<IsConst>::operator--() & {
+typename Deque<T, Alloc, BucketLength>::template common_iterator<IsConst>&
+    Deque<T, Alloc, BucketLength>::common_iterator<IsConst>::operator--() & {
     if (_index == 0) {
         _index = BUCKET_LENGTH - 1;
         --_bucket;
@@ -431,56 +930,1079 @@ typename Deque<T>::template common_iterator<IsConst>&
     return *this;
 }
 
-template <typename T>
+template <typename T, typename Alloc, size_t BucketLength>
 template <bool IsConst>
-typename Deque<T>::template common_iterator<IsConst>&
-    Deque<T>::common_iterator<IsConst>::operator+=(size_t n) {
-    _index += n;
-    _bucket += _index / BUCKET_LENGTH;
-    _index %= BUCKET_LENGTH;
+typename Deque<T, Alloc, BucketLength>::template common_iterator<IsConst>&
+    Deque<T, Alloc, BucketLength>::common_iterator<IsConst>::operator+=(difference_type n) {
+    difference_type index = static_cast<difference_type>(_index) + n;
+    _bucket += index >> BUCKET_SHIFT;
+    _index = static_cast<size_t>(index) & BUCKET_MASK;
     return *this;
 }
 
-template <typename T>
+template <typename T, typename Alloc, size_t BucketLength>
+template <bool IsConst>
+typename Deque<T, Alloc, BucketLength>::template common_iterator<IsConst>&
+    Deque<T, Alloc, BucketLength>::common_iterator<IsConst>::operator-=(difference_type n) {
+    return *this += -n;
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
 template <bool IsConst>
-typename Deque<T>::template common_iterator<IsConst>
-    Deque<T>::common_iterator<IsConst>::operator+(size_t n) {
+typename Deque<T, Alloc, BucketLength>::template common_iterator<IsConst>
+    Deque<T, Alloc, BucketLength>::common_iterator<IsConst>::operator+(difference_type n) const {
     common_iterator<IsConst> it(_index, _bucket);
     it += n;
     return it;
 }
 
-template <typename T>
+template <typename T, typename Alloc, size_t BucketLength>
 template <bool IsConst>
-typename Deque<T>::template common_iterator<IsConst>
-    Deque<T>::common_iterator<IsConst>::operator-(size_t n) {
+typename Deque<T, Alloc, BucketLength>::template common_iterator<IsConst>
+    Deque<T, Alloc, BucketLength>::common_iterator<IsConst>::operator-(difference_type n) const {
     common_iterator<IsConst> it(_index, _bucket);
-    long long diff = _index - n;
-    if (diff >= 0) {
-        it._index = diff;
-        return it;
-    }
-
-    diff *= -1;
-    it._bucket -= diff / BUCKET_LENGTH + 1;
-    it._index = BUCKET_LENGTH - (diff % BUCKET_LENGTH);
+    it -= n;
     return it;
 }
 
-template <typename T>
+template <typename T, typename Alloc, size_t BucketLength>
 template <bool IsConst>
-bool Deque<T>::common_iterator<IsConst>::operator>(
-    const common_iterator<IsConst>& rhs) {
+bool Deque<T, Alloc, BucketLength>::common_iterator<IsConst>::operator>(
+    const common_iterator<IsConst>& rhs) const {
     if (_bucket > rhs._bucket) return true;
     if (_bucket == rhs._bucket && _index > rhs._index) return true;
     return false;
 }
 
-template <typename T>
+template <typename T, typename Alloc, size_t BucketLength>
 template <bool IsConst>
-bool Deque<T>::common_iterator<IsConst>::operator<(
-    const common_iterator<IsConst>& rhs) {
+bool Deque<T, Alloc, BucketLength>::common_iterator<IsConst>::operator<(
+    const common_iterator<IsConst>& rhs) const {
     if (_bucket < rhs._bucket) return true;
     if (_bucket == rhs._bucket && _index < rhs._index) return true;
     return false;
 }
+
+// Segment-aware versions of the standard algorithms: each runs the plain
+// algorithm over the contiguous span of every bucket, where the compiler can
+// vectorize it, instead of going through deque iterators.
+template <typename T, typename Alloc, size_t BucketLength, typename Function>
+Function for_each(Deque<T, Alloc, BucketLength>& deque, Function function) {
+    for (std::span<T> segment : deque.segments()) {
+        for (T& value : segment) {
+            function(value);
+        }
+    }
+    return function;
+}
+
+template <typename T, typename Alloc, size_t BucketLength, typename Function>
+Function for_each(const Deque<T, Alloc, BucketLength>& deque,
+                  Function function) {
+    for (std::span<const T> segment : deque.segments()) {
+        for (const T& value : segment) {
+            function(value);
+        }
+    }
+    return function;
+}
+
+template <typename T, typename Alloc, size_t BucketLength, typename OutputIt>
+OutputIt copy(const Deque<T, Alloc, BucketLength>& deque, OutputIt out) {
+    for (std::span<const T> segment : deque.segments()) {
+        out = std::copy(segment.begin(), segment.end(), out);
+    }
+    return out;
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+void fill(Deque<T, Alloc, BucketLength>& deque, const T& value) {
+    for (std::span<T> segment : deque.segments()) {
+        std::fill(segment.begin(), segment.end(), value);
+    }
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+typename Deque<T, Alloc, BucketLength>::iterator find(
+    Deque<T, Alloc, BucketLength>& deque, const T& value) {
+    size_t position = 0;
+    for (std::span<T> segment : deque.segments()) {
+        auto it = std::find(segment.begin(), segment.end(), value);
+        if (it != segment.end()) {
+            return deque.begin() + (position + (it - segment.begin()));
+        }
+        position += segment.size();
+    }
+    return deque.end();
+}
+
+template <typename T, typename Alloc, size_t BucketLength>
+typename Deque<T, Alloc, BucketLength>::const_iterator find(
+    const Deque<T, Alloc, BucketLength>& deque, const T& value) {
+    size_t position = 0;
+    for (std::span<const T> segment : deque.segments()) {
+        auto it = std::find(segment.begin(), segment.end(), value);
+        if (it != segment.end()) {
+            return deque.cbegin() + (position + (it - segment.begin()));
+        }
+        position += segment.size();
+    }
+    return deque.cend();
+}
+
+
+// Deque with a fixed capacity of N elements kept inline, for queues with a
+// known small bound such as sliding windows. The elements sit in a ring of
+// bit_ceil(N) slots, so positions map to slots with a mask and nothing is
+// ever allocated. Pushing onto a full deque throws std::length_error.
+template <typename T, size_t N>
+class StaticDeque {
+    static_assert(N > 0, "capacity must be positive");
+
+   private:
+    template <bool IsConst>
+    struct common_iterator;
+
+   public:
+    using value_type = T;
+    using iterator = common_iterator<false>;
+    using const_iterator = common_iterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    StaticDeque() = default;
+    StaticDeque(std::initializer_list<T> values);
+    StaticDeque(const StaticDeque& deque);
+    StaticDeque(StaticDeque&& deque) noexcept(
+        std::is_nothrow_move_constructible<T>::value);
+    ~StaticDeque();
+    StaticDeque& operator=(const StaticDeque& deque);
+    StaticDeque& operator=(StaticDeque&& deque) noexcept(
+        std::is_nothrow_move_constructible<T>::value);
+
+    T& operator[](size_t index) { return *_slot(_head + index); }
+
+    const T& operator[](size_t index) const {
+        return *_slot(_head + index);
+    }
+
+    T& at(size_t index);
+    const T& at(size_t index) const;
+    void push_back(const T& value);
+    void push_back(T&& value);
+    void push_front(const T& value);
+    void push_front(T&& value);
+    template <typename... Args>
+    T& emplace_back(Args&&... args);
+    template <typename... Args>
+    T& emplace_front(Args&&... args);
+    void pop_back();
+    void pop_front();
+    void clear();
+
+    size_t size() const { return _deque_size; }
+
+    bool empty() const { return _deque_size == 0; }
+
+    bool full() const { return _deque_size == N; }
+
+    static constexpr size_t capacity() { return N; }
+
+    const_iterator cbegin() const { return const_iterator(_data(), _head); }
+
+    const_iterator cend() const { return cbegin() + _deque_size; }
+
+    iterator begin() { return iterator(_data(), _head); }
+
+    iterator end() { return begin() + _deque_size; }
+
+    const_iterator begin() const { return cbegin(); }
+
+    const_iterator end() const { return cend(); }
+
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+
+    const_reverse_iterator rcbegin() const {
+        return const_reverse_iterator(cend());
+    }
+
+    const_reverse_iterator rcend() const {
+        return const_reverse_iterator(cbegin());
+    }
+
+   private:
+    // Iterators hold the unmasked position, so they stay ordered across
+    // the wrap of the ring.
+    template <bool IsConst>
+    struct common_iterator {
+       public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = std::conditional_t<IsConst, const T*, T*>;
+        using reference = std::conditional_t<IsConst, const T&, T&>;
+        using iterator_category = std::random_access_iterator_tag;
+
+        common_iterator() = default;
+        common_iterator(pointer data, size_t position)
+            : _data(data), _position(position) {}
+        common_iterator(const common_iterator<false>& other)
+            : _data(other._data), _position(other._position) {}
+
+        reference operator*() const { return _data[_position & MASK]; }
+
+        pointer operator->() const { return _data + (_position & MASK); }
+
+        reference operator[](difference_type n) const {
+            return *(*this + n);
+        }
+
+        common_iterator& operator++() {
+            ++_position;
+            return *this;
+        }
+
+        common_iterator operator++(int) {
+            common_iterator it = *this;
+            ++_position;
+            return it;
+        }
+
+        common_iterator& operator--() {
+            --_position;
+            return *this;
+        }
+
+        common_iterator operator--(int) {
+            common_iterator it = *this;
+            --_position;
+            return it;
+        }
+
+        common_iterator& operator+=(difference_type n) {
+            _position += n;
+            return *this;
+        }
+
+        common_iterator& operator-=(difference_type n) {
+            _position -= n;
+            return *this;
+        }
+
+        common_iterator operator+(difference_type n) const {
+            return common_iterator(_data, _position + n);
+        }
+
+        common_iterator operator-(difference_type n) const {
+            return common_iterator(_data, _position - n);
+        }
+
+        difference_type operator-(const common_iterator& rhs) const {
+            return static_cast<difference_type>(_position - rhs._position);
+        }
+
+        bool operator==(const common_iterator& rhs) const {
+            return _position == rhs._position;
+        }
+
+        bool operator!=(const common_iterator& rhs) const {
+            return !(*this == rhs);
+        }
+
+        bool operator<(const common_iterator& rhs) const {
+            return *this - rhs < 0;
+        }
+
+        bool operator>(const common_iterator& rhs) const {
+            return rhs < *this;
+        }
+
+        bool operator<=(const common_iterator& rhs) const {
+            return !(rhs < *this);
+        }
+
+        bool operator>=(const common_iterator& rhs) const {
+            return !(*this < rhs);
+        }
+
+        friend common_iterator operator+(difference_type n,
+                                         const common_iterator& it) {
+            return it + n;
+        }
+
+       private:
+        friend struct common_iterator<!IsConst>;
+
+        pointer _data = nullptr;
+        size_t _position = 0;
+    };
+
+    static constexpr size_t CAPACITY = std::bit_ceil(N);
+    static constexpr size_t MASK = CAPACITY - 1;
+
+    T* _data() { return std::launder(reinterpret_cast<T*>(_storage)); }
+
+    const T* _data() const {
+        return std::launder(reinterpret_cast<const T*>(_storage));
+    }
+
+    T* _slot(size_t position) { return _data() + (position & MASK); }
+
+    const T* _slot(size_t position) const {
+        return _data() + (position & MASK);
+    }
+
+    void _check_capacity() const;
+    template <bool Move, typename Range>
+    void _append_all(Range& values);
+
+    alignas(T) unsigned char _storage[CAPACITY * sizeof(T)];
+    size_t _head = 0;
+    size_t _deque_size = 0;
+};
+
+template <typename T, size_t N>
+StaticDeque<T, N>::StaticDeque(std::initializer_list<T> values) {
+    _append_all<false>(values);
+}
+
+template <typename T, size_t N>
+StaticDeque<T, N>::StaticDeque(const StaticDeque& deque) {
+    _append_all<false>(deque);
+}
+
+template <typename T, size_t N>
+StaticDeque<T, N>::StaticDeque(StaticDeque&& deque) noexcept(
+    std::is_nothrow_move_constructible<T>::value) {
+    _append_all<true>(deque);
+}
+
+template <typename T, size_t N>
+StaticDeque<T, N>::~StaticDeque() {
+    clear();
+}
+
+template <typename T, size_t N>
+StaticDeque<T, N>& StaticDeque<T, N>::operator=(const StaticDeque& deque) {
+    if (this != &deque) {
+        clear();
+        _append_all<false>(deque);
+    }
+    return *this;
+}
+
+template <typename T, size_t N>
+StaticDeque<T, N>& StaticDeque<T, N>::operator=(StaticDeque&& deque) noexcept(
+    std::is_nothrow_move_constructible<T>::value) {
+    if (this != &deque) {
+        clear();
+        _append_all<true>(deque);
+    }
+    return *this;
+}
+
+// Copies or moves every element of values to the back. If one throws, the
+// elements appended so far are destroyed again: a constructor's caller never
+// sees them, and the destructor does not run for a half-constructed deque.
+template <typename T, size_t N>
+template <bool Move, typename Range>
+void StaticDeque<T, N>::_append_all(Range& values) {
+    try {
+        for (auto& value : values) {
+            if constexpr (Move) {
+                emplace_back(std::move(value));
+            } else {
+                emplace_back(value);
+            }
+        }
+    } catch (...) {
+        clear();
+        throw;
+    }
+}
+
+template <typename T, size_t N>
+T& StaticDeque<T, N>::at(size_t index) {
+    if (index >= _deque_size) {
+        throw std::out_of_range("out of range");
+    }
+    return (*this)[index];
+}
+
+template <typename T, size_t N>
+const T& StaticDeque<T, N>::at(size_t index) const {
+    if (index >= _deque_size) {
+        throw std::out_of_range("out of range");
+    }
+    return (*this)[index];
+}
+
+template <typename T, size_t N>
+void StaticDeque<T, N>::push_back(const T& value) {
+    emplace_back(value);
+}
+
+template <typename T, size_t N>
+void StaticDeque<T, N>::push_back(T&& value) {
+    emplace_back(std::move(value));
+}
+
+template <typename T, size_t N>
+void StaticDeque<T, N>::push_front(const T& value) {
+    emplace_front(value);
+}
+
+template <typename T, size_t N>
+void StaticDeque<T, N>::push_front(T&& value) {
+    emplace_front(std::move(value));
+}
+
+template <typename T, size_t N>
+template <typename... Args>
+T& StaticDeque<T, N>::emplace_back(Args&&... args) {
+    _check_capacity();
+    T* place = new (_slot(_head + _deque_size)) T(std::forward<Args>(args)...);
+    ++_deque_size;
+    return *place;
+}
+
+template <typename T, size_t N>
+template <typename... Args>
+T& StaticDeque<T, N>::emplace_front(Args&&... args) {
+    _check_capacity();
+    T* place = new (_slot(_head - 1)) T(std::forward<Args>(args)...);
+    --_head;
+    ++_deque_size;
+    return *place;
+}
+
+template <typename T, size_t N>
+void StaticDeque<T, N>::pop_back() {
+    --_deque_size;
+    _slot(_head + _deque_size)->~T();
+}
+
+template <typename T, size_t N>
+void StaticDeque<T, N>::pop_front() {
+    _slot(_head)->~T();
+    ++_head;
+    --_deque_size;
+}
+
+template <typename T, size_t N>
+void StaticDeque<T, N>::clear() {
+    if constexpr (!std::is_trivially_destructible<T>::value) {
+        for (size_t i = 0; i < _deque_size; ++i) {
+            _slot(_head + i)->~T();
+        }
+    }
+    _deque_size = 0;
+}
+
+template <typename T, size_t N>
+void StaticDeque<T, N>::_check_capacity() const {
+    if (_deque_size == N) {
+        throw std::length_error("StaticDeque is full");
+    }
+}
+
+
+// Wait-free queue between one producer and one consumer thread, laid out
+// like a Deque: elements live in buckets of BucketLength slots chained into
+// a list. The producer publishes an element by storing its bucket's new
+// written count, the consumer drains a bucket up to that count and follows
+// the link once the bucket is used up. Drained buckets go back to the
+// producer through a one-slot spare, so steady traffic allocates nothing.
+template <typename T, size_t BucketLength = default_bucket_length<T>()>
+class SpscQueue {
+   public:
+    SpscQueue();
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    ~SpscQueue();
+
+    void push(const T& value);
+    void push(T&& value);
+    template <typename... Args>
+    void emplace(Args&&... args);
+    bool try_pop(T& value);
+
+   private:
+    struct Bucket {
+        std::atomic<size_t> written{0};
+        std::atomic<Bucket*> next{nullptr};
+        alignas(T) unsigned char storage[BucketLength * sizeof(T)];
+
+        T* slot(size_t index) {
+            return std::launder(reinterpret_cast<T*>(storage) + index);
+        }
+    };
+
+    static constexpr size_t CACHE_LINE = 64;
+
+    // Owned by the consumer.
+    alignas(CACHE_LINE) Bucket* _head;
+    size_t _head_index = 0;
+    // Owned by the producer.
+    alignas(CACHE_LINE) Bucket* _tail;
+    size_t _tail_index = 0;
+    alignas(CACHE_LINE) std::atomic<Bucket*> _spare{nullptr};
+};
+
+template <typename T, size_t BucketLength>
+SpscQueue<T, BucketLength>::SpscQueue() : _head(new Bucket), _tail(_head) {}
+
+template <typename T, size_t BucketLength>
+SpscQueue<T, BucketLength>::~SpscQueue() {
+    size_t index = _head_index;
+    while (_head != nullptr) {
+        size_t written = _head->written.load(std::memory_order_relaxed);
+        for (; index < written; ++index) {
+            _head->slot(index)->~T();
+        }
+        Bucket* next = _head->next.load(std::memory_order_relaxed);
+        delete _head;
+        _head = next;
+        index = 0;
+    }
+    delete _spare.load(std::memory_order_relaxed);
+}
+
+template <typename T, size_t BucketLength>
+void SpscQueue<T, BucketLength>::push(const T& value) {
+    emplace(value);
+}
+
+template <typename T, size_t BucketLength>
+void SpscQueue<T, BucketLength>::push(T&& value) {
+    emplace(std::move(value));
+}
+
+// A full bucket is linked to a fresh one before the element is built, so the
+// consumer only ever follows the link out of a bucket it has used up.
+template <typename T, size_t BucketLength>
+template <typename... Args>
+void SpscQueue<T, BucketLength>::emplace(Args&&... args) {
+    if (_tail_index == BucketLength) {
+        Bucket* bucket = _spare.exchange(nullptr, std::memory_order_acquire);
+        if (bucket == nullptr) {
+            bucket = new Bucket;
+        } else {
+            bucket->written.store(0, std::memory_order_relaxed);
+            bucket->next.store(nullptr, std::memory_order_relaxed);
+        }
+        _tail->next.store(bucket, std::memory_order_release);
+        _tail = bucket;
+        _tail_index = 0;
+    }
+    new (_tail->slot(_tail_index)) T(std::forward<Args>(args)...);
+    _tail->written.store(++_tail_index, std::memory_order_release);
+}
+
+template <typename T, size_t BucketLength>
+bool SpscQueue<T, BucketLength>::try_pop(T& value) {
+    if (_head_index == BucketLength) {
+        Bucket* next = _head->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            return false;
+        }
+        Bucket* drained = _head;
+        _head = next;
+        _head_index = 0;
+        delete _spare.exchange(drained, std::memory_order_acq_rel);
+    }
+    if (_head_index == _head->written.load(std::memory_order_acquire)) {
+        return false;
+    }
+    T* slot = _head->slot(_head_index);
+    value = std::move(*slot);
+    slot->~T();
+    ++_head_index;
+    return true;
+}
+
+
+// Lock-free bounded queue for any number of producers and consumers
+// (Vyukov's array queue). Positions map onto a power-of-two ring of cells by
+// a mask, like Deque positions onto buckets; every cell carries a sequence
+// number telling which lap of the ring it is ready for, so a producer and a
+// consumer only ever contend on the cell and the position counter they both
+// want. Memory is allocated once, which keeps reclamation trivial.
+template <typename T>
+class MpmcQueue {
+    static_assert(std::is_nothrow_move_constructible<T>::value &&
+                      std::is_nothrow_move_assignable<T>::value,
+                  "a claimed cell must be filled and emptied without throwing");
+
+   public:
+    explicit MpmcQueue(size_t capacity);
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+    ~MpmcQueue();
+
+    bool try_push(const T& value);
+    bool try_push(T&& value);
+    template <typename... Args>
+    bool try_emplace(Args&&... args);
+    bool try_pop(T& value);
+
+    size_t capacity() const { return _mask + 1; }
+
+   private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* slot() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    static constexpr size_t CACHE_LINE = 64;
+
+    Cell* _cells;
+    size_t _mask;
+    alignas(CACHE_LINE) std::atomic<size_t> _enqueue_position{0};
+    alignas(CACHE_LINE) std::atomic<size_t> _dequeue_position{0};
+};
+
+template <typename T>
+MpmcQueue<T>::MpmcQueue(size_t capacity)
+    : _cells(new Cell[std::bit_ceil(std::max<size_t>(capacity, 2))]),
+      _mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1) {
+    for (size_t i = 0; i <= _mask; ++i) {
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+MpmcQueue<T>::~MpmcQueue() {
+    size_t end = _enqueue_position.load(std::memory_order_relaxed);
+    size_t position = _dequeue_position.load(std::memory_order_relaxed);
+    for (; position != end; ++position) {
+        _cells[position & _mask].slot()->~T();
+    }
+    delete[] _cells;
+}
+
+template <typename T>
+bool MpmcQueue<T>::try_push(const T& value) {
+    return try_emplace(value);
+}
+
+template <typename T>
+bool MpmcQueue<T>::try_push(T&& value) {
+    return try_emplace(std::move(value));
+}
+
+// The element is built before a cell is claimed: once the position counter
+// moves past a cell, consumers wait for that cell to be published.
+template <typename T>
+template <typename... Args>
+bool MpmcQueue<T>::try_emplace(Args&&... args) {
+    T value(std::forward<Args>(args)...);
+    size_t position = _enqueue_position.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &_cells[position & _mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+        if (lag == 0) {
+            if (_enqueue_position.compare_exchange_weak(
+                    position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            return false;
+        } else {
+            position = _enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+    new (cell->slot()) T(std::move(value));
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool MpmcQueue<T>::try_pop(T& value) {
+    size_t position = _dequeue_position.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &_cells[position & _mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        auto lag = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+        if (lag == 0) {
+            if (_dequeue_position.compare_exchange_weak(
+                    position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            return false;
+        } else {
+            position = _dequeue_position.load(std::memory_order_relaxed);
+        }
+    }
+    T* slot = cell->slot();
+    value = std::move(*slot);
+    slot->~T();
+    cell->sequence.store(position + _mask + 1, std::memory_order_release);
+    return true;
+}
+
+
+// Chase-Lev work-stealing deque (in the C11 formulation of Le et al.): the
+// owner thread pushes and pops at the bottom, any thread may steal from the
+// top. The ring buffer doubles like Deque::_grow_buffer() when the owner
+// fills it. Thieves may still be reading an outgrown buffer, so those are
+// kept until the deque dies; their total size stays below the live one.
+// Elements are copied through std::atomic, so T is meant to be a pointer or
+// a handle.
+template <typename T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "elements are copied through std::atomic<T>");
+
+   public:
+    explicit WorkStealingDeque(size_t capacity = 64);
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+    ~WorkStealingDeque();
+
+    void push(T value);
+    bool pop(T& value);
+    bool steal(T& value);
+
+    bool empty() const {
+        return _bottom.load(std::memory_order_relaxed) <=
+               _top.load(std::memory_order_relaxed);
+    }
+
+   private:
+    struct Buffer {
+        size_t mask;
+        std::unique_ptr<std::atomic<T>[]> cells;
+
+        explicit Buffer(size_t capacity)
+            : mask(capacity - 1), cells(new std::atomic<T>[capacity]) {}
+
+        T load(std::ptrdiff_t index) const {
+            return cells[index & mask].load(std::memory_order_relaxed);
+        }
+
+        void store(std::ptrdiff_t index, T value) {
+            cells[index & mask].store(value, std::memory_order_relaxed);
+        }
+    };
+
+    static constexpr size_t CACHE_LINE = 64;
+
+    Buffer* _grow_buffer(Buffer* buffer, std::ptrdiff_t top,
+                         std::ptrdiff_t bottom);
+
+    alignas(CACHE_LINE) std::atomic<std::ptrdiff_t> _top{0};
+    alignas(CACHE_LINE) std::atomic<std::ptrdiff_t> _bottom{0};
+    std::atomic<Buffer*> _buffer;
+    std::vector<std::unique_ptr<Buffer>> _buffers;
+};
+
+template <typename T>
+WorkStealingDeque<T>::WorkStealingDeque(size_t capacity) {
+    _buffers.emplace_back(
+        new Buffer(std::bit_ceil(std::max<size_t>(capacity, 2))));
+    _buffer.store(_buffers.back().get(), std::memory_order_relaxed);
+}
+
+template <typename T>
+WorkStealingDeque<T>::~WorkStealingDeque() = default;
+
+template <typename T>
+void WorkStealingDeque<T>::push(T value) {
+    std::ptrdiff_t bottom = _bottom.load(std::memory_order_relaxed);
+    std::ptrdiff_t top = _top.load(std::memory_order_acquire);
+    Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+    if (bottom - top > static_cast<std::ptrdiff_t>(buffer->mask)) {
+        buffer = _grow_buffer(buffer, top, bottom);
+    }
+    buffer->store(bottom, value);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+}
+
+// The owner claims the bottom element before looking at the top; only when
+// a single element is left does it race the thieves for it on the top.
+template <typename T>
+bool WorkStealingDeque<T>::pop(T& value) {
+    std::ptrdiff_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+    Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+    _bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::ptrdiff_t top = _top.load(std::memory_order_relaxed);
+    if (top > bottom) {
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+    T popped = buffer->load(bottom);
+    if (top == bottom) {
+        bool won = _top.compare_exchange_strong(top, top + 1,
+                                                std::memory_order_seq_cst,
+                                                std::memory_order_relaxed);
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+        if (!won) {
+            return false;
+        }
+    }
+    value = popped;
+    return true;
+}
+
+template <typename T>
+bool WorkStealingDeque<T>::steal(T& value) {
+    std::ptrdiff_t top = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::ptrdiff_t bottom = _bottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+        return false;
+    }
+    Buffer* buffer = _buffer.load(std::memory_order_acquire);
+    T stolen = buffer->load(top);
+    if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+        return false;
+    }
+    value = stolen;
+    return true;
+}
+
+template <typename T>
+typename WorkStealingDeque<T>::Buffer* WorkStealingDeque<T>::_grow_buffer(
+    Buffer* buffer, std::ptrdiff_t top, std::ptrdiff_t bottom) {
+    _buffers.emplace_back(new Buffer(2 * (buffer->mask + 1)));
+    Buffer* grown = _buffers.back().get();
+    for (std::ptrdiff_t i = top; i < bottom; ++i) {
+        grown->store(i, buffer->load(i));
+    }
+    _buffer.store(grown, std::memory_order_release);
+    return grown;
+}
+
+
+class TaskGroup;
+
+// Fork-join scheduler: every worker owns a WorkStealingDeque of tasks and
+// runs its own tasks newest first, which keeps recursive splits depth-first
+// and cache-warm, while idle workers steal the oldest, biggest tasks from
+// the others. Tasks submitted from outside the pool go through a shared
+// queue. Workers with nothing to do sleep until a task is submitted.
+class ThreadPool {
+   public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    size_t size() const { return _threads.size(); }
+
+   private:
+    friend class TaskGroup;
+
+    struct Task {
+        std::function<void()> function;
+        TaskGroup* group;
+    };
+
+    void _submit(Task* task);
+    bool _run_one();
+    Task* _take();
+    void _work(size_t index);
+
+    std::vector<std::unique_ptr<WorkStealingDeque<Task*>>> _queues;
+    std::vector<std::thread> _threads;
+    Deque<Task*> _injected;
+    // Mirrors _injected.size() so idle workers can skip the lock while
+    // nothing was submitted from outside.
+    std::atomic<size_t> _injected_count{0};
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::atomic<size_t> _queued{0};
+    std::atomic<size_t> _sleeping{0};
+    bool _stopping = false;
+
+    static inline thread_local ThreadPool* _current_pool = nullptr;
+    static inline thread_local size_t _current_index = 0;
+};
+
+// Tasks spawned by run() may run on any worker of the pool. wait() does not
+// block the calling thread: it executes queued tasks until all tasks of the
+// group are done, so groups can nest inside tasks, and rethrows the first
+// exception a task of the group threw.
+class TaskGroup {
+   public:
+    explicit TaskGroup(ThreadPool& pool) : _pool(pool) {}
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    ~TaskGroup();
+
+    template <typename Function>
+    void run(Function&& function);
+    void wait();
+
+   private:
+    friend class ThreadPool;
+
+    void _finish(std::exception_ptr exception);
+
+    ThreadPool& _pool;
+    std::atomic<size_t> _pending{0};
+    std::mutex _mutex;
+    std::exception_ptr _exception;
+};
+
+inline ThreadPool::ThreadPool(size_t threads) {
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; ++i) {
+        _queues.emplace_back(new WorkStealingDeque<Task*>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        _threads.emplace_back(&ThreadPool::_work, this, i);
+    }
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (std::thread& thread : _threads) {
+        thread.join();
+    }
+}
+
+// A worker that found nothing registers as sleeping before it rechecks the
+// queued count, and a submitter bumps the count before it checks for
+// sleepers, so one of the two always sees the other. The count goes up
+// before the task is published so a thief's decrement cannot wrap it.
+inline void ThreadPool::_submit(Task* task) {
+    _queued.fetch_add(1);
+    try {
+        if (_current_pool == this) {
+            _queues[_current_index]->push(task);
+        } else {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _injected.push_back(task);
+            _injected_count.fetch_add(1, std::memory_order_release);
+        }
+    } catch (...) {
+        _queued.fetch_sub(1);
+        throw;
+    }
+    if (_sleeping.load() > 0) {
+        { std::lock_guard<std::mutex> lock(_mutex); }
+        _wake.notify_one();
+    }
+}
+
+inline ThreadPool::Task* ThreadPool::_take() {
+    Task* task = nullptr;
+    if (_current_pool == this && _queues[_current_index]->pop(task)) {
+        return task;
+    }
+    if (_injected_count.load(std::memory_order_acquire) > 0) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_injected.empty()) {
+            task = _injected[0];
+            _injected.pop_front();
+            _injected_count.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    size_t start = _current_pool == this ? _current_index + 1 : 0;
+    for (size_t i = 0; i < _queues.size(); ++i) {
+        if (_queues[(start + i) % _queues.size()]->steal(task)) {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+inline bool ThreadPool::_run_one() {
+    if (_queued.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    Task* task = _take();
+    if (task == nullptr) {
+        return false;
+    }
+    _queued.fetch_sub(1, std::memory_order_relaxed);
+    TaskGroup* group = task->group;
+    std::exception_ptr exception;
+    try {
+        task->function();
+    } catch (...) {
+        exception = std::current_exception();
+    }
+    delete task;
+    group->_finish(exception);
+    return true;
+}
+
+inline void ThreadPool::_work(size_t index) {
+    _current_pool = this;
+    _current_index = index;
+    while (true) {
+        if (_run_one()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _sleeping.fetch_add(1);
+        _wake.wait(lock, [this] { return _stopping || _queued.load() > 0; });
+        _sleeping.fetch_sub(1);
+        if (_stopping && _queued.load() == 0) {
+            return;
+        }
+    }
+}
+
+inline TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+template <typename Function>
+void TaskGroup::run(Function&& function) {
+    std::unique_ptr<ThreadPool::Task> task(
+        new ThreadPool::Task{std::forward<Function>(function), this});
+    _pending.fetch_add(1, std::memory_order_relaxed);
+    try {
+        _pool._submit(task.get());
+    } catch (...) {
+        _pending.fetch_sub(1, std::memory_order_relaxed);
+        throw;
+    }
+    task.release();
+}
+
+inline void TaskGroup::wait() {
+    while (_pending.load(std::memory_order_acquire) != 0) {
+        if (!_pool._run_one()) {
+            std::this_thread::yield();
+        }
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_exception) {
+        std::exception_ptr exception = std::move(_exception);
+        _exception = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+inline void TaskGroup::_finish(std::exception_ptr exception) {
+    if (exception) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_exception) {
+            _exception = exception;
+        }
+    }
+    _pending.fetch_sub(1, std::memory_order_release);
+}
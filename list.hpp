@@ -1,4 +1,14 @@
 #include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <thread>
+#include <utility>
 
 template <size_t N>
 class StackStorage {
@@ -86,6 +96,322 @@ bool operator!=(const StackAllocator<T, N>& lhs
 }
 
 
+// Bump allocator like StackStorage, but once the inline buffer of N bytes
+// is used up it chains heap blocks, each at least twice the size of the
+// previous one, instead of running off its end. mark() and rewind() release
+// everything allocated after the mark at once, reset() releases everything;
+// blocks are kept for reuse and returned to the system with the storage.
+template <size_t N>
+class ArenaStorage {
+private:
+    struct alignas(std::max_align_t) Block {
+        Block* next;
+        size_t size;
+
+        uint8_t* begin() {
+            return reinterpret_cast<uint8_t*>(this) + sizeof(Block);
+        }
+
+        uint8_t* end() {
+            return begin() + size;
+        }
+    };
+
+public:
+    struct Mark {
+        Block* block;
+        uint8_t* pointer;
+    };
+
+    ArenaStorage(): _memory_pointer(_memory), _memory_end(_memory + N) {};
+    ArenaStorage(const ArenaStorage&) = delete;
+    ArenaStorage& operator=(const ArenaStorage&) = delete;
+    ~ArenaStorage();
+    uint8_t* get_pointer(size_t count_bytes, size_t align_size);
+
+    Mark mark() const {
+        return Mark{_block, _memory_pointer};
+    }
+
+    void rewind(Mark mark);
+
+    void reset() {
+        rewind(Mark{nullptr, _memory});
+    }
+
+private:
+    static constexpr size_t MIN_BLOCK_SIZE = 4096;
+
+    void next_block(size_t count_bytes);
+
+    uint8_t _memory[N > 0 ? N : 1];
+    uint8_t* _memory_pointer;
+    uint8_t* _memory_end;
+    Block* _block = nullptr;
+    Block* _blocks = nullptr;
+};
+
+template <size_t N>
+ArenaStorage<N>::~ArenaStorage() {
+    while (_blocks != nullptr) {
+        Block* next = _blocks->next;
+        ::operator delete(_blocks);
+        _blocks = next;
+    }
+}
+
+template <size_t N>
+uint8_t* ArenaStorage<N>::get_pointer(size_t count_bytes, size_t align_size) {
+    size_t padding = (align_size - reinterpret_cast<uintptr_t>(_memory_pointer) % align_size) % align_size;
+    if (static_cast<size_t>(_memory_end - _memory_pointer) < padding + count_bytes) {
+        next_block(count_bytes + align_size);
+        padding = (align_size - reinterpret_cast<uintptr_t>(_memory_pointer) % align_size) % align_size;
+    }
+    uint8_t* ptr = _memory_pointer + padding;
+    _memory_pointer = ptr + count_bytes;
+    return ptr;
+}
+
+template <size_t N>
+void ArenaStorage<N>::rewind(Mark mark) {
+    _block = mark.block;
+    _memory_pointer = mark.pointer;
+    _memory_end = _block == nullptr ? _memory + N : _block->end();
+}
+
+// Moves on to the block after the current one, reusing it when a rewind
+// left one large enough, otherwise splicing a new block in front of it.
+template <size_t N>
+void ArenaStorage<N>::next_block(size_t count_bytes) {
+    Block** link = _block == nullptr ? &_blocks : &_block->next;
+    Block* block = *link;
+    if (block == nullptr || block->size < count_bytes) {
+        size_t size = std::max(std::max(N, MIN_BLOCK_SIZE), count_bytes);
+        if (_block != nullptr) {
+            size = std::max(size, 2 * _block->size);
+        }
+        block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+        block->size = size;
+        block->next = *link;
+        *link = block;
+    }
+    _block = block;
+    _memory_pointer = block->begin();
+    _memory_end = block->end();
+}
+
+
+// Drop-in replacement for StackAllocator over an ArenaStorage.
+template <typename T, size_t N>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = ArenaAllocator<U, N>;
+    };
+
+    ArenaAllocator() = default;
+    explicit ArenaAllocator(ArenaStorage<N>& storage): _memory(&storage) {};
+    ~ArenaAllocator() = default;
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U, N>& other)
+            : _memory(other.get_memory()) {};
+
+    T* allocate(size_t count_objects);
+    void deallocate(T*, size_t) noexcept {};
+    ArenaStorage<N>* get_memory() const;
+
+private:
+    ArenaStorage<N>* _memory;
+};
+
+template <typename T, size_t N>
+T* ArenaAllocator<T, N>::allocate(size_t count_objects) {
+    return reinterpret_cast<T*>(
+            _memory->get_pointer(count_objects * sizeof(T), alignof(T)));
+}
+
+template <typename T, size_t N>
+ArenaStorage<N>* ArenaAllocator<T, N>::get_memory() const {
+    return _memory;
+}
+
+template <typename T, size_t N, typename U, size_t M>
+bool operator==(const ArenaAllocator<T, N>& lhs
+        , const ArenaAllocator<U, M>& rhs) {
+    return lhs.get_memory() == rhs.get_memory();
+}
+
+template <typename T, size_t N, typename U, size_t M>
+bool operator!=(const ArenaAllocator<T, N>& lhs
+        , const ArenaAllocator<U, M>& rhs) {
+    return lhs.get_memory() != rhs.get_memory();
+}
+
+// Fixed-size block pool: requests are rounded up to a size class of
+// BLOCK_ALIGN bytes, blocks are carved from SLAB_SIZE slabs by a bump
+// pointer, and a freed block goes onto an intrusive free list of its class
+// to be handed out again. Slabs return to the system only when the storage
+// dies. Larger or overaligned requests fall through to operator new.
+class PoolStorage {
+public:
+    PoolStorage() = default;
+    PoolStorage(const PoolStorage&) = delete;
+    PoolStorage& operator=(const PoolStorage&) = delete;
+    ~PoolStorage();
+    uint8_t* get_pointer(size_t count_bytes, size_t align_size);
+    void return_pointer(uint8_t* pointer, size_t count_bytes, size_t align_size) noexcept;
+
+    // One storage per thread, for containers that are created and
+    // destroyed on the same thread: no locking and no sharing of cache
+    // lines between threads.
+    static PoolStorage& thread_local_storage();
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct alignas(std::max_align_t) Slab {
+        Slab* next;
+    };
+
+    static const size_t BLOCK_ALIGN = alignof(std::max_align_t);
+    static const size_t MAX_BLOCK_SIZE = 256;
+    static const size_t CLASS_COUNT = MAX_BLOCK_SIZE / BLOCK_ALIGN;
+    static const size_t SLAB_SIZE = 64 * 1024;
+
+    static bool is_pooled(size_t count_bytes, size_t align_size);
+    uint8_t* carve(size_t block_size);
+
+    FreeBlock* _free_lists[CLASS_COUNT] = {};
+    Slab* _slabs = nullptr;
+    uint8_t* _slab_pointer = nullptr;
+    uint8_t* _slab_end = nullptr;
+};
+
+inline PoolStorage::~PoolStorage() {
+    while (_slabs != nullptr) {
+        Slab* next = _slabs->next;
+        ::operator delete(_slabs);
+        _slabs = next;
+    }
+}
+
+inline bool PoolStorage::is_pooled(size_t count_bytes, size_t align_size) {
+    return count_bytes != 0 && count_bytes <= MAX_BLOCK_SIZE && align_size <= BLOCK_ALIGN;
+}
+
+inline uint8_t* PoolStorage::get_pointer(size_t count_bytes, size_t align_size) {
+    if (!is_pooled(count_bytes, align_size)) {
+        return static_cast<uint8_t*>(::operator new(count_bytes, std::align_val_t(align_size)));
+    }
+    size_t size_class = (count_bytes - 1) / BLOCK_ALIGN;
+    FreeBlock* block = _free_lists[size_class];
+    if (block != nullptr) {
+        _free_lists[size_class] = block->next;
+        return reinterpret_cast<uint8_t*>(block);
+    }
+    return carve((size_class + 1) * BLOCK_ALIGN);
+}
+
+inline void PoolStorage::return_pointer(uint8_t* pointer, size_t count_bytes, size_t align_size) noexcept {
+    if (!is_pooled(count_bytes, align_size)) {
+        ::operator delete(pointer, std::align_val_t(align_size));
+        return;
+    }
+    size_t size_class = (count_bytes - 1) / BLOCK_ALIGN;
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(pointer);
+    block->next = _free_lists[size_class];
+    _free_lists[size_class] = block;
+}
+
+inline uint8_t* PoolStorage::carve(size_t block_size) {
+    if (static_cast<size_t>(_slab_end - _slab_pointer) < block_size) {
+        Slab* slab = static_cast<Slab*>(::operator new(SLAB_SIZE));
+        slab->next = _slabs;
+        _slabs = slab;
+        _slab_pointer = reinterpret_cast<uint8_t*>(slab) + sizeof(Slab);
+        _slab_end = reinterpret_cast<uint8_t*>(slab) + SLAB_SIZE;
+    }
+    uint8_t* block = _slab_pointer;
+    _slab_pointer += block_size;
+    return block;
+}
+
+inline PoolStorage& PoolStorage::thread_local_storage() {
+    thread_local PoolStorage storage;
+    return storage;
+}
+
+
+// Allocator over a PoolStorage. There is no default storage: pass one
+// explicitly, or opt into the calling thread's cache with per_thread(),
+// which is only safe for containers created and destroyed on that thread
+// before it exits.
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = PoolAllocator<U>;
+    };
+
+    explicit PoolAllocator(PoolStorage& storage): _memory(&storage) {};
+    ~PoolAllocator() = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other)
+            : _memory(other.get_memory()) {};
+
+    static PoolAllocator per_thread();
+
+    T* allocate(size_t count_objects);
+    void deallocate(T* pointer, size_t count_objects) noexcept;
+    PoolStorage* get_memory() const;
+
+private:
+    PoolStorage* _memory;
+};
+
+template <typename T>
+PoolAllocator<T> PoolAllocator<T>::per_thread() {
+    return PoolAllocator(PoolStorage::thread_local_storage());
+}
+
+template <typename T>
+T* PoolAllocator<T>::allocate(size_t count_objects) {
+    return reinterpret_cast<T*>(
+            _memory->get_pointer(count_objects * sizeof(T), alignof(T)));
+}
+
+template <typename T>
+void PoolAllocator<T>::deallocate(T* pointer, size_t count_objects) noexcept {
+    _memory->return_pointer(reinterpret_cast<uint8_t*>(pointer)
+            , count_objects * sizeof(T), alignof(T));
+}
+
+template <typename T>
+PoolStorage* PoolAllocator<T>::get_memory() const {
+    return _memory;
+}
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) {
+    return lhs.get_memory() == rhs.get_memory();
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) {
+    return lhs.get_memory() != rhs.get_memory();
+}
+
+
 template <bool B, typename T, typename U>
 struct Conditional;
 
@@ -109,20 +435,22 @@ private:
     template <bool IsConst>
     struct common_iterator;
 
+    class NodeHandle;
+
     struct BaseNode {
         BaseNode* prev;
         BaseNode* next;
     };
 
     struct Node: BaseNode {
-        Node() = default;
-        explicit Node(const T& val): value(val) {}
+        template <typename... Args>
+        explicit Node(Args&&... args): value(std::forward<Args>(args)...) {}
         T value;
     };
 
 public:
     using value_type = T;
-    using allocator_type = typename Alloc::template rebind<Node>::other;
+    using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
     using size_type = size_t;
     using difference_type = ptrdiff_t;
     using reference = const value_type&;
@@ -132,6 +460,7 @@ public:
     using const_iterator = common_iterator<true>;
     using reverse_iterator = std::reverse_iterator<iterator>;
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    using node_type = NodeHandle;
 
     List();
     explicit List(size_t count);
@@ -140,8 +469,12 @@ public:
 		List(size_t count, const Alloc& allocator);
     List(size_t count, const T& value, const Alloc& allocator);
     List(const List<T, Alloc>& other);
+    List(List<T, Alloc>&& other) noexcept;
     ~List();
     List<T, Alloc>& operator=(const List<T, Alloc>& other);
+    List<T, Alloc>& operator=(List<T, Alloc>&& other) noexcept(
+            std::allocator_traits<allocator_type>::propagate_on_container_move_assignment::value
+            || std::allocator_traits<allocator_type>::is_always_equal::value);
 
     allocator_type get_allocator() const {
         return _alloc;
@@ -156,11 +489,29 @@ public:
     }
 
     void push_back(const T& value) {
-        insert(end(), value);
+        emplace(end(), value);
+    }
+
+    void push_back(T&& value) {
+        emplace(end(), std::move(value));
     }
 
     void push_front(const T& value) {
-        insert(begin(), value);
+        emplace(begin(), value);
+    }
+
+    void push_front(T&& value) {
+        emplace(begin(), std::move(value));
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        return *emplace(end(), std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    T& emplace_front(Args&&... args) {
+        return *emplace(begin(), std::forward<Args>(args)...);
     }
 
     void pop_back() {
@@ -171,34 +522,71 @@ public:
         erase(begin());
     }
 
-    void insert(iterator it, const T& value);
-    void insert(const_iterator it, const T& value);
-    void insert(iterator it);
-    void erase(iterator it);
-    void erase(const_iterator it);
+    void clear() {
+        while (!empty()) {
+            erase(begin());
+        }
+    }
+
+    template <typename... Args>
+    iterator emplace(const_iterator it, Args&&... args);
+    iterator insert(const_iterator it, const T& value);
+    iterator insert(const_iterator it, T&& value);
+    iterator insert(const_iterator it);
+    iterator insert(const_iterator it, node_type&& node);
+    iterator erase(const_iterator it);
+    node_type extract(const_iterator it);
+
+    // Splicing relinks nodes without copying or allocating; other must use
+    // an allocator equal to ours.
+    void splice(const_iterator it, List<T, Alloc>& other);
+    void splice(const_iterator it, List<T, Alloc>&& other);
+    void splice(const_iterator it, List<T, Alloc>& other, const_iterator element);
+    void splice(const_iterator it, List<T, Alloc>& other
+            , const_iterator first, const_iterator last);
+
+    // Sorting and merging relink nodes in place, stably and without
+    // allocating. parallel_sort cuts the list into one sublist per thread,
+    // sorts them on std::threads and merges the results pairwise; threads == 0
+    // means one per hardware thread. If a comparison throws, every element
+    // stays in the list in unspecified order.
+    template <typename Compare = std::less<>>
+    void sort(Compare comp = Compare());
+    template <typename Compare = std::less<>>
+    void parallel_sort(size_t threads = 0, Compare comp = Compare());
+    template <typename Compare = std::less<>>
+    void merge(List<T, Alloc>& other, Compare comp = Compare());
+    template <typename Compare = std::less<>>
+    void merge(List<T, Alloc>&& other, Compare comp = Compare());
+    template <typename BinaryPredicate = std::equal_to<>>
+    size_t unique(BinaryPredicate pred = BinaryPredicate());
+    template <typename UnaryPredicate>
+    size_t remove_if(UnaryPredicate pred);
+    size_t remove(const T& value);
+    void reverse();
 
     iterator end() {
-        return iterator(_fake_node);
+        return iterator(&_fake_node);
     }
 
     iterator begin() {
-        return iterator(_fake_node->next);
+        return iterator(_fake_node.next);
     }
 
     const_iterator end() const {
-        return const_iterator(_fake_node);
+        return const_iterator(end_node());
     }
 
     const_iterator begin() const {
-        return const_iterator(_fake_node->next);
+        return const_iterator(_fake_node.next);
     }
 
     const_iterator cend() const {
-        return const_iterator(_fake_node);
+        return const_iterator(end_node());
     }
 
     const_iterator cbegin() const {
-        return const_iterator(_fake_node->next);
+        return const_iterator(_fake_node.next);
     }
 
     reverse_iterator rbegin() {
@@ -235,6 +623,8 @@ private:
         using reference = ConditionalValue<IsConst, const T&, T&>;
         using iterator_category = std::bidirectional_iterator_tag;
 
+        common_iterator() = default;
+
         explicit common_iterator(BaseNode* node)
             : _node(node) {};
 
@@ -246,11 +636,11 @@ private:
             return *this;
         }
 
-        ConditionalValue<IsConst, const T&, T&> operator*() {
+        ConditionalValue<IsConst, const T&, T&> operator*() const {
             return static_cast<Node*>(_node)->value;
         }
 
-        ConditionalValue<IsConst, const T*, T*> operator->() {
+        ConditionalValue<IsConst, const T*, T*> operator->() const {
             return &(static_cast<Node*>(_node)->value);
         }
 
@@ -290,23 +680,23 @@ private:
             return *this;
         }
 
-        common_iterator<IsConst> operator+(size_t n) {
+        common_iterator<IsConst> operator+(size_t n) const {
             common_iterator<IsConst> it(_node);
             it += n;
             return it;
         }
 
-        common_iterator<IsConst> operator-(size_t n) {
+        common_iterator<IsConst> operator-(size_t n) const {
             common_iterator<IsConst> it(_node);
             it -= n;
             return it;
         }
 
-        bool operator==(const common_iterator<IsConst>& rhs) {
+        bool operator==(const common_iterator<IsConst>& rhs) const {
             return _node == rhs._node;
         }
 
-        bool operator!=(const common_iterator<IsConst>& rhs) {
+        bool operator!=(const common_iterator<IsConst>& rhs) const {
             return _node != rhs._node;
         }
 
@@ -315,217 +705,1555 @@ private:
         }
 
     private:
-        BaseNode* _node;
+        BaseNode* _node = nullptr;
+    };
+
+    // Owns a node taken out of a list by extract(), value and all, until it
+    // is inserted into a list again or the handle dies.
+    class NodeHandle {
+    public:
+        NodeHandle() = default;
+        NodeHandle(const NodeHandle&) = delete;
+
+        NodeHandle(NodeHandle&& other) noexcept
+                : _node(other._node)
+                , _alloc(other._alloc) {
+            other._node = nullptr;
+        }
+
+        NodeHandle& operator=(NodeHandle&& other) noexcept {
+            if (this != &other) {
+                reset();
+                _node = other._node;
+                _alloc = other._alloc;
+                other._node = nullptr;
+            }
+            return *this;
+        }
+
+        ~NodeHandle() {
+            reset();
+        }
+
+        bool empty() const {
+            return _node == nullptr;
+        }
+
+        explicit operator bool() const {
+            return _node != nullptr;
+        }
+
+        T& value() const {
+            return _node->value;
+        }
+
+        allocator_type get_allocator() const {
+            return _alloc;
+        }
+
+    private:
+        friend class List;
+
+        NodeHandle(Node* node, const allocator_type& allocator)
+                : _node(node)
+                , _alloc(allocator) {}
+
+        void reset() {
+            if (_node != nullptr) {
+                AllocTraits::destroy(_alloc, _node);
+                AllocTraits::deallocate(_alloc, _node, 1);
+                _node = nullptr;
+            }
+        }
+
+        Node* _node = nullptr;
+        allocator_type _alloc;
     };
 
     using AllocTraits = std::allocator_traits<allocator_type>;
+
+    BaseNode* end_node() const {
+        return const_cast<BaseNode*>(&_fake_node);
+    }
+
+    template <typename Construct>
+    void insert_chain(BaseNode* position, size_t count, Construct construct);
+    void link(BaseNode* position, BaseNode* node);
+    void unlink(BaseNode* node);
+    static void transfer(BaseNode* position, BaseNode* first, BaseNode* last);
+
+    static const T& value_of(BaseNode* node) {
+        return static_cast<Node*>(node)->value;
+    }
+
+    BaseNode* detach_chain();
+    void attach_chain(BaseNode* head);
+    template <typename Compare>
+    static void merge_chains(BaseNode*& first, BaseNode* second, Compare& comp);
+    template <typename Compare>
+    static void sort_chain(BaseNode*& head, Compare& comp);
+    static void append_chain(BaseNode*& head, BaseNode* tail);
+
+    // Below this many nodes per thread parallel_sort stays on one thread.
+    static constexpr size_t PARALLEL_SORT_GRAIN = 1 << 14;
+    static constexpr size_t MAX_SORT_THREADS = 64;
+
     allocator_type  _alloc;
-    BaseNode* _fake_node;
+    // The sentinel lives inside the list, so moving a list only relinks its
+    // first and last nodes.
+    BaseNode _fake_node{&_fake_node, &_fake_node};
     size_t _list_size;
 };
 
 
 template <typename T, typename Alloc>
 List<T, Alloc>::List()
-        : _fake_node(AllocTraits::allocate(_alloc, 1))
-        ,	_list_size(0) {
-    AllocTraits::construct(_alloc, _fake_node);
-    _fake_node->prev = _fake_node;
-    _fake_node->next = _fake_node;
-}
+        : _list_size(0) {}
 
 template <typename T, typename Alloc>
 List<T, Alloc>::List(size_t count): List() {
-    try {
-        for (size_t i = 0; i < count; ++i) {
-            insert(end());
-        }
-    } catch (...) {
-        while (!empty()) {
-            erase(begin());
-        }
-        throw;
-    }
+    insert_chain(&_fake_node, count, [this](Node* node) {
+        AllocTraits::construct(_alloc, node);
+    });
 }
 
 template <typename T, typename Alloc>
 List<T, Alloc>::List(size_t count, const T& value): List() {
-    try {
-        for (size_t i = 0; i < count; ++i) {
-            insert(end(), value);
-        }
-    } catch (...) {
-        while (!empty()) {
-            erase(begin());
-        }
-        AllocTraits::destroy(_alloc, _fake_node);
-        AllocTraits::deallocate(_alloc, static_cast<Node*>(_fake_node), 1);
-        throw;
-    }
+    insert_chain(&_fake_node, count, [this, &value](Node* node) {
+        AllocTraits::construct(_alloc, node, value);
+    });
 }
 
 template <typename T, typename Alloc>
 List<T, Alloc>::List(const Alloc& allocator)
         : _alloc(AllocTraits::select_on_container_copy_construction(allocator))
-        , _fake_node(AllocTraits::allocate(_alloc, 1))
-        ,	_list_size(0) {
-    AllocTraits::construct(_alloc, _fake_node);
-    _fake_node->prev = _fake_node;
-    _fake_node->next = _fake_node;
-}
+        ,	_list_size(0) {}
 
 template <typename T, typename Alloc>
 List<T, Alloc>::List(size_t count, const Alloc& allocator)
         : List(allocator) {
-    try {
-        for (size_t i = 0; i < count; ++i) {
-            insert(end());
-        }
-    } catch (...) {
-        while (!empty()) {
-            erase(begin());
-        }
-        AllocTraits::destroy(_alloc, _fake_node);
-        AllocTraits::deallocate(_alloc, static_cast<Node*>(_fake_node), 1);
-        throw;
-    }
+    insert_chain(&_fake_node, count, [this](Node* node) {
+        AllocTraits::construct(_alloc, node);
+    });
 }
 
 template <typename T, typename Alloc>
 List<T, Alloc>::List(size_t count, const T& value, const Alloc& allocator)
         : List(allocator) {
-    try {
-        for (size_t i = 0; i < count; ++i) {
-            insert(end(), value);
-        }
-    } catch (...) {
-        while (!empty()) {
-            erase(begin());
-        }
-        AllocTraits::destroy(_alloc, _fake_node);
-        AllocTraits::deallocate(_alloc, static_cast<Node*>(_fake_node), 1);
-        throw;
-    }
+    insert_chain(&_fake_node, count, [this, &value](Node* node) {
+        AllocTraits::construct(_alloc, node, value);
+    });
 }
 
 template <typename T, typename Alloc>
 List<T, Alloc>::List(const List<T, Alloc>& other)
         : List(other._alloc) {
-    try {
-        for (BaseNode* node = other._fake_node->next; node != other._fake_node; node = node->next) {
-            insert(end(), static_cast<Node*>(node)->value);
-        }
-    } catch (...) {
-        while (!empty()) {
-            erase(begin());
-        }
-        throw;
-    }
+    const BaseNode* source = other._fake_node.next;
+    insert_chain(&_fake_node, other._list_size, [this, &source](Node* node) {
+        AllocTraits::construct(_alloc, node, static_cast<const Node*>(source)->value);
+        source = source->next;
+    });
+}
+
+template <typename T, typename Alloc>
+List<T, Alloc>::List(List<T, Alloc>&& other) noexcept
+        : _alloc(other._alloc)
+        , _list_size(0) {
+    splice(end(), other);
 }
 
+// Existing nodes take the leading values by assignment, so only the
+// difference in size is allocated or freed and the list never holds both
+// copies at once. Nodes of an allocator that is about to be replaced are
+// freed first.
 template <typename T, typename Alloc>
 List<T, Alloc>& List<T, Alloc>::operator=(const List<T, Alloc>& other) {
     if (&other != this) {
-        if (AllocTraits::propagate_on_container_copy_assignment::value) {
+        if constexpr (AllocTraits::propagate_on_container_copy_assignment::value) {
+            if (_alloc != other._alloc) {
+                clear();
+            }
             _alloc = other._alloc;
         }
-        size_t copy_size = _list_size;
-        try {
-            for (BaseNode* node = other._fake_node->next; node != other._fake_node; node = node->next) {
-                insert(end(), static_cast<Node*>(node)->value);
-            }
-        } catch (...) {
-            while(_list_size > copy_size) {
-                erase(--end());
-            }
-            throw;
+        BaseNode* node = _fake_node.next;
+        const BaseNode* source = other._fake_node.next;
+        for (; node != &_fake_node && source != &other._fake_node; node = node->next, source = source->next) {
+            static_cast<Node*>(node)->value = static_cast<const Node*>(source)->value;
         }
-        for(size_t i = 0; i < copy_size; ++i) {
-            erase(begin());
+        while (node != &_fake_node) {
+            node = erase(const_iterator(node)).get_node();
         }
+        insert_chain(&_fake_node, other._list_size - _list_size, [this, &source](Node* node) {
+            AllocTraits::construct(_alloc, node, static_cast<const Node*>(source)->value);
+            source = source->next;
+        });
     }
     return *this;
 }
 
+// Nodes can change hands only between equal allocators; otherwise the
+// values are moved into nodes of our own allocator.
 template <typename T, typename Alloc>
-void List<T, Alloc>::insert(iterator it, const T& value) {
-    try {
-        Node* new_node = AllocTraits::allocate(_alloc, 1);
-        AllocTraits::construct(_alloc, new_node, value);
-        new_node->prev = it.get_node()->prev;
-        it.get_node()->prev->next = new_node;
-        it.get_node()->prev = new_node;
-        new_node->next = it.get_node();
-        ++_list_size;
-    } catch (...) {
-        throw;
+List<T, Alloc>& List<T, Alloc>::operator=(List<T, Alloc>&& other) noexcept(
+        std::allocator_traits<allocator_type>::propagate_on_container_move_assignment::value
+        || std::allocator_traits<allocator_type>::is_always_equal::value) {
+    if (&other != this) {
+        clear();
+        if constexpr (AllocTraits::propagate_on_container_move_assignment::value) {
+            _alloc = other._alloc;
+        }
+        if (_alloc == other._alloc) {
+            splice(end(), other);
+        } else {
+            for (BaseNode* node = other._fake_node.next; node != &other._fake_node; node = node->next) {
+                insert(end(), std::move(static_cast<Node*>(node)->value));
+            }
+        }
     }
+    return *this;
 }
 
 template <typename T, typename Alloc>
-void List<T, Alloc>::insert(const_iterator it, const T& value) {
+template <typename... Args>
+typename List<T, Alloc>::iterator List<T, Alloc>::emplace(const_iterator it, Args&&... args) {
+    Node* new_node = AllocTraits::allocate(_alloc, 1);
     try {
-        Node* new_node = AllocTraits::allocate(_alloc, 1);
-        AllocTraits::construct(_alloc, new_node, value);
-        new_node->prev = it.get_node()->prev;
-        it.get_node()->prev->next = new_node;
-        it.get_node()->prev = new_node;
-        new_node->next = it.get_node();
-        ++_list_size;
+        AllocTraits::construct(_alloc, new_node, std::forward<Args>(args)...);
     } catch (...) {
+        AllocTraits::deallocate(_alloc, new_node, 1);
         throw;
     }
+    link(it.get_node(), new_node);
+    return iterator(new_node);
 }
 
 template <typename T, typename Alloc>
-void List<T, Alloc>::insert(iterator it) {
+typename List<T, Alloc>::iterator List<T, Alloc>::insert(const_iterator it, const T& value) {
+    return emplace(it, value);
+}
+
+template <typename T, typename Alloc>
+typename List<T, Alloc>::iterator List<T, Alloc>::insert(const_iterator it, T&& value) {
+    return emplace(it, std::move(value));
+}
+
+template <typename T, typename Alloc>
+typename List<T, Alloc>::iterator List<T, Alloc>::insert(const_iterator it) {
+    return emplace(it);
+}
+
+template <typename T, typename Alloc>
+typename List<T, Alloc>::iterator List<T, Alloc>::insert(const_iterator it, node_type&& node) {
+    if (node.empty()) {
+        return iterator(it.get_node());
+    }
+    Node* new_node = node._node;
+    node._node = nullptr;
+    link(it.get_node(), new_node);
+    return iterator(new_node);
+}
+
+template <typename T, typename Alloc>
+typename List<T, Alloc>::iterator List<T, Alloc>::erase(const_iterator it) {
+    BaseNode* old_node = it.get_node();
+    BaseNode* next = old_node->next;
+    unlink(old_node);
+    AllocTraits::destroy(_alloc, static_cast<Node*>(old_node));
+    AllocTraits::deallocate(_alloc, static_cast<Node*>(old_node), 1);
+    return iterator(next);
+}
+
+template <typename T, typename Alloc>
+typename List<T, Alloc>::node_type List<T, Alloc>::extract(const_iterator it) {
+    BaseNode* old_node = it.get_node();
+    unlink(old_node);
+    return node_type(static_cast<Node*>(old_node), _alloc);
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::splice(const_iterator it, List<T, Alloc>& other) {
+    if (&other != this && !other.empty()) {
+        transfer(it.get_node(), other._fake_node.next, &other._fake_node);
+        _list_size += other._list_size;
+        other._list_size = 0;
+    }
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::splice(const_iterator it, List<T, Alloc>&& other) {
+    splice(it, other);
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::splice(const_iterator it, List<T, Alloc>& other, const_iterator element) {
+    BaseNode* node = element.get_node();
+    if (it.get_node() == node || it.get_node() == node->next) {
+        return;
+    }
+    transfer(it.get_node(), node, node->next);
+    --other._list_size;
+    ++_list_size;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::splice(const_iterator it, List<T, Alloc>& other
+        , const_iterator first, const_iterator last) {
+    if (first == last) {
+        return;
+    }
+    if (&other != this) {
+        size_t count = 0;
+        for (BaseNode* node = first.get_node(); node != last.get_node(); node = node->next) {
+            ++count;
+        }
+        other._list_size -= count;
+        _list_size += count;
+    }
+    transfer(it.get_node(), first.get_node(), last.get_node());
+}
+
+template <typename T, typename Alloc>
+template <typename Compare>
+void List<T, Alloc>::sort(Compare comp) {
+    if (_list_size < 2) {
+        return;
+    }
+    BaseNode* head = detach_chain();
     try {
-        Node* new_node = AllocTraits::allocate(_alloc, 1);
-        AllocTraits::construct(_alloc, new_node);
-        new_node->prev = it.get_node()->prev;
-        it.get_node()->prev->next = new_node;
-        it.get_node()->prev = new_node;
-        new_node->next = it.get_node();
-        ++_list_size;
+        sort_chain(head, comp);
+    } catch (...) {
+        attach_chain(head);
+        throw;
+    }
+    attach_chain(head);
+}
+
+template <typename T, typename Alloc>
+template <typename Compare>
+void List<T, Alloc>::parallel_sort(size_t threads, Compare comp) {
+    if (threads == 0) {
+        threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    threads = std::min({threads, MAX_SORT_THREADS, _list_size / PARALLEL_SORT_GRAIN});
+    if (threads < 2) {
+        sort(comp);
+        return;
+    }
+
+    BaseNode* chunks[MAX_SORT_THREADS];
+    std::exception_ptr errors[MAX_SORT_THREADS];
+    BaseNode* node = detach_chain();
+    for (size_t i = 0; i < threads; ++i) {
+        chunks[i] = node;
+        size_t length = _list_size / threads + (i < _list_size % threads);
+        for (size_t j = 1; j < length; ++j) {
+            node = node->next;
+        }
+        BaseNode* next = node->next;
+        node->next = nullptr;
+        node = next;
+    }
+
+    // Runs task(0) .. task(count - 1) with all but the first on their own
+    // threads; each thread gets its own copy of comp. If a thread cannot be
+    // started, it and the tasks after it run on the calling thread instead,
+    // so the workers already started are always joined.
+    auto run = [&errors, &comp](size_t count, auto task) {
+        std::thread workers[MAX_SORT_THREADS];
+        size_t started = 1;
+        try {
+            for (; started < count; ++started) {
+                workers[started] = std::thread([&errors, task, k = started, comp]() mutable {
+                    try {
+                        task(k, comp);
+                    } catch (...) {
+                        errors[k] = std::current_exception();
+                    }
+                });
+            }
+        } catch (...) {
+            // Out of threads or unable to copy comp: run the rest below.
+        }
+        auto run_here = [&errors, &task, &comp](size_t k) {
+            try {
+                task(k, comp);
+            } catch (...) {
+                errors[k] = std::current_exception();
+            }
+        };
+        run_here(0);
+        for (size_t k = started; k < count; ++k) {
+            run_here(k);
+        }
+        for (size_t k = 1; k < started; ++k) {
+            workers[k].join();
+        }
+        for (size_t k = 0; k < count; ++k) {
+            if (errors[k]) {
+                return errors[k];
+            }
+        }
+        return std::exception_ptr();
+    };
+
+    std::exception_ptr error = run(threads, [&chunks](size_t k, Compare& task_comp) {
+        sort_chain(chunks[k], task_comp);
+    });
+    for (size_t stride = 1; stride < threads && !error; stride *= 2) {
+        size_t pairs = (threads - stride + 2 * stride - 1) / (2 * stride);
+        error = run(pairs, [&chunks, stride](size_t k, Compare& task_comp) {
+            size_t i = 2 * k * stride;
+            merge_chains(chunks[i], std::exchange(chunks[i + stride], nullptr), task_comp);
+        });
+    }
+
+    for (size_t i = 1; i < threads; ++i) {
+        append_chain(chunks[0], chunks[i]);
+    }
+    attach_chain(chunks[0]);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+template <typename T, typename Alloc>
+template <typename Compare>
+void List<T, Alloc>::merge(List<T, Alloc>& other, Compare comp) {
+    if (&other == this) {
+        return;
+    }
+    BaseNode* position = _fake_node.next;
+    BaseNode* other_node = other._fake_node.next;
+    size_t moved = 0;
+    try {
+        while (position != &_fake_node && other_node != &other._fake_node) {
+            if (comp(value_of(other_node), value_of(position))) {
+                BaseNode* next = other_node->next;
+                transfer(position, other_node, next);
+                other_node = next;
+                ++moved;
+            } else {
+                position = position->next;
+            }
+        }
+    } catch (...) {
+        _list_size += moved;
+        other._list_size -= moved;
+        throw;
+    }
+    if (other_node != &other._fake_node) {
+        transfer(&_fake_node, other_node, &other._fake_node);
+    }
+    _list_size += other._list_size;
+    other._list_size = 0;
+}
+
+template <typename T, typename Alloc>
+template <typename Compare>
+void List<T, Alloc>::merge(List<T, Alloc>&& other, Compare comp) {
+    merge(other, std::move(comp));
+}
+
+template <typename T, typename Alloc>
+template <typename BinaryPredicate>
+size_t List<T, Alloc>::unique(BinaryPredicate pred) {
+    size_t removed = 0;
+    if (_list_size < 2) {
+        return removed;
+    }
+    BaseNode* kept = _fake_node.next;
+    for (BaseNode* node = kept->next; node != &_fake_node;) {
+        BaseNode* next = node->next;
+        if (pred(value_of(kept), value_of(node))) {
+            erase(const_iterator(node));
+            ++removed;
+        } else {
+            kept = node;
+        }
+        node = next;
+    }
+    return removed;
+}
+
+template <typename T, typename Alloc>
+template <typename UnaryPredicate>
+size_t List<T, Alloc>::remove_if(UnaryPredicate pred) {
+    size_t removed = 0;
+    for (BaseNode* node = _fake_node.next; node != &_fake_node;) {
+        BaseNode* next = node->next;
+        if (pred(value_of(node))) {
+            erase(const_iterator(node));
+            ++removed;
+        }
+        node = next;
+    }
+    return removed;
+}
+
+// value may refer into the list itself, so its node is erased last.
+template <typename T, typename Alloc>
+size_t List<T, Alloc>::remove(const T& value) {
+    size_t removed = 0;
+    BaseNode* self = nullptr;
+    for (BaseNode* node = _fake_node.next; node != &_fake_node;) {
+        BaseNode* next = node->next;
+        if (value_of(node) == value) {
+            if (&value_of(node) == &value) {
+                self = node;
+            } else {
+                erase(const_iterator(node));
+            }
+            ++removed;
+        }
+        node = next;
+    }
+    if (self != nullptr) {
+        erase(const_iterator(self));
+    }
+    return removed;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::reverse() {
+    BaseNode* node = &_fake_node;
+    do {
+        std::swap(node->prev, node->next);
+        node = node->prev;
+    } while (node != &_fake_node);
+}
+
+// Unhooks all nodes as a chain linked through next and ending in nullptr;
+// _list_size is kept for the matching attach_chain.
+template <typename T, typename Alloc>
+typename List<T, Alloc>::BaseNode* List<T, Alloc>::detach_chain() {
+    BaseNode* head = _fake_node.next;
+    _fake_node.prev->next = nullptr;
+    _fake_node.next = &_fake_node;
+    _fake_node.prev = &_fake_node;
+    return head;
+}
+
+// Links a nullptr-terminated chain back in and rebuilds its prev pointers.
+template <typename T, typename Alloc>
+void List<T, Alloc>::attach_chain(BaseNode* head) {
+    BaseNode* prev = &_fake_node;
+    for (BaseNode* node = head; node != nullptr; node = node->next) {
+        node->prev = prev;
+        prev->next = node;
+        prev = node;
+    }
+    prev->next = &_fake_node;
+    _fake_node.prev = prev;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::append_chain(BaseNode*& head, BaseNode* tail) {
+    if (tail == nullptr) {
+        return;
+    }
+    BaseNode** link = &head;
+    while (*link != nullptr) {
+        link = &(*link)->next;
+    }
+    *link = tail;
+}
+
+// Stable merge of two sorted chains into first. An element of second goes
+// ahead only if it compares strictly less. If comp throws, first still ends
+// up holding every node of both chains.
+template <typename T, typename Alloc>
+template <typename Compare>
+void List<T, Alloc>::merge_chains(BaseNode*& first, BaseNode* second, Compare& comp) {
+    BaseNode* head = nullptr;
+    BaseNode** tail = &head;
+    try {
+        while (first != nullptr && second != nullptr) {
+            if (comp(value_of(second), value_of(first))) {
+                *tail = second;
+                second = second->next;
+            } else {
+                *tail = first;
+                first = first->next;
+            }
+            tail = &(*tail)->next;
+        }
     } catch (...) {
+        *tail = first;
+        append_chain(head, second);
+        first = head;
         throw;
     }
+    *tail = first != nullptr ? first : second;
+    first = head;
 }
 
+// Bottom-up merge sort: bins[i] holds a sorted run of 2^i nodes, and each
+// node taken from the input is carried up through the occupied bins like a
+// binary counter. Runs in higher bins are older, so they go first in merges.
 template <typename T, typename Alloc>
-void List<T, Alloc>::erase(iterator it) {
+template <typename Compare>
+void List<T, Alloc>::sort_chain(BaseNode*& head, Compare& comp) {
+    BaseNode* bins[64] = {};
+    size_t used = 0;
+    BaseNode* carry = nullptr;
     try {
-        BaseNode* old_node = it.get_node();
-        old_node->prev->next = old_node->next;
-        old_node->next->prev = old_node->prev;
-        AllocTraits::destroy(_alloc, static_cast<Node*>(old_node));
-        AllocTraits::deallocate(_alloc, static_cast<Node*>(old_node), 1);
-        --_list_size;
+        while (head != nullptr) {
+            carry = head;
+            head = head->next;
+            carry->next = nullptr;
+            size_t i = 0;
+            for (; bins[i] != nullptr; ++i) {
+                merge_chains(bins[i], std::exchange(carry, nullptr), comp);
+                carry = std::exchange(bins[i], nullptr);
+            }
+            bins[i] = std::exchange(carry, nullptr);
+            used = std::max(used, i + 1);
+        }
+        for (size_t i = 1; i < used; ++i) {
+            if (bins[i] != nullptr) {
+                merge_chains(bins[i], std::exchange(bins[i - 1], nullptr), comp);
+            } else {
+                bins[i] = std::exchange(bins[i - 1], nullptr);
+            }
+        }
     } catch (...) {
+        append_chain(head, carry);
+        for (size_t i = 0; i < used; ++i) {
+            append_chain(head, bins[i]);
+        }
         throw;
     }
+    head = used > 0 ? bins[used - 1] : nullptr;
 }
 
+// Builds count nodes as a detached chain and links the whole chain in front
+// of position at once. If a constructor throws, the nodes built so far are
+// freed and the list is left as it was.
 template <typename T, typename Alloc>
-void List<T, Alloc>::erase(const_iterator it) {
+template <typename Construct>
+void List<T, Alloc>::insert_chain(BaseNode* position, size_t count, Construct construct) {
+    if (count == 0) {
+        return;
+    }
+    BaseNode chain{&chain, &chain};
     try {
-        BaseNode* old_node = it.get_node();
-        old_node->prev->next = old_node->next;
-        old_node->next->prev = old_node->prev;
-        AllocTraits::destroy(_alloc, static_cast<Node*>(old_node));
-        AllocTraits::deallocate(_alloc, static_cast<Node*>(old_node), 1);
-        --_list_size;
+        for (size_t i = 0; i < count; ++i) {
+            Node* node = AllocTraits::allocate(_alloc, 1);
+            try {
+                construct(node);
+            } catch (...) {
+                AllocTraits::deallocate(_alloc, node, 1);
+                throw;
+            }
+            node->prev = chain.prev;
+            node->next = &chain;
+            chain.prev->next = node;
+            chain.prev = node;
+        }
     } catch (...) {
+        for (BaseNode* node = chain.next; node != &chain;) {
+            BaseNode* next = node->next;
+            AllocTraits::destroy(_alloc, static_cast<Node*>(node));
+            AllocTraits::deallocate(_alloc, static_cast<Node*>(node), 1);
+            node = next;
+        }
         throw;
     }
+    transfer(position, chain.next, &chain);
+    _list_size += count;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::link(BaseNode* position, BaseNode* node) {
+    node->prev = position->prev;
+    node->next = position;
+    position->prev->next = node;
+    position->prev = node;
+    ++_list_size;
+}
+
+template <typename T, typename Alloc>
+void List<T, Alloc>::unlink(BaseNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    --_list_size;
+}
+
+// Moves the nodes [first, last) in front of position, which must not lie
+// inside the range; the sizes of the lists involved are up to the caller.
+template <typename T, typename Alloc>
+void List<T, Alloc>::transfer(BaseNode* position, BaseNode* first, BaseNode* last) {
+    if (first == last || position == last) {
+        return;
+    }
+    BaseNode* tail = last->prev;
+    first->prev->next = last;
+    last->prev = first->prev;
+    first->prev = position->prev;
+    tail->next = position;
+    position->prev->next = first;
+    position->prev = tail;
 }
 
 template <typename T, typename Alloc>
 List<T, Alloc>::~List() {
-    while(!empty()) {
+    clear();
+}
+
+
+// List that keeps up to NODE_CAPACITY elements per node, with nodes sized to
+// NodeBytes (two cache lines by default): a traversal walks contiguous runs
+// of elements and follows a pointer once per node instead of once per
+// element. An insert into a full node splits it in half, an erase that
+// leaves a node sparse merges it with its successor when both fit in one,
+// so edits stay local and nodes stay at least partly filled.
+template <typename T, typename Alloc = std::allocator<T>, size_t NodeBytes = 128>
+class UnrolledList {
+private:
+    template <bool IsConst>
+    struct common_iterator;
+
+    struct BaseNode {
+        BaseNode* prev;
+        BaseNode* next;
+        size_t count;
+    };
+
+    static constexpr size_t NODE_CAPACITY =
+            NodeBytes > sizeof(BaseNode) + 2 * sizeof(T) ? (NodeBytes - sizeof(BaseNode)) / sizeof(T) : 2;
+
+    struct Node: BaseNode {
+        alignas(T) unsigned char storage[NODE_CAPACITY * sizeof(T)];
+
+        T* slot(size_t index) {
+            return std::launder(reinterpret_cast<T*>(storage) + index);
+        }
+    };
+
+public:
+    using value_type = T;
+    using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using iterator = common_iterator<false>;
+    using const_iterator = common_iterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    UnrolledList();
+    explicit UnrolledList(const Alloc& allocator);
+    UnrolledList(const UnrolledList& other);
+    UnrolledList(UnrolledList&& other) noexcept;
+    ~UnrolledList();
+    UnrolledList& operator=(const UnrolledList& other);
+    UnrolledList& operator=(UnrolledList&& other) noexcept(
+            std::allocator_traits<allocator_type>::propagate_on_container_move_assignment::value
+            || std::allocator_traits<allocator_type>::is_always_equal::value);
+
+    allocator_type get_allocator() const {
+        return _alloc;
+    }
+
+    bool empty() const {
+        return !(_list_size);
+    }
+
+    size_t size() const {
+        return _list_size;
+    }
+
+    static constexpr size_t node_capacity() {
+        return NODE_CAPACITY;
+    }
+
+    void push_back(const T& value) {
+        emplace(end(), value);
+    }
+
+    void push_back(T&& value) {
+        emplace(end(), std::move(value));
+    }
+
+    void push_front(const T& value) {
+        emplace(begin(), value);
+    }
+
+    void push_front(T&& value) {
+        emplace(begin(), std::move(value));
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        return *emplace(end(), std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    T& emplace_front(Args&&... args) {
+        return *emplace(begin(), std::forward<Args>(args)...);
+    }
+
+    void pop_back() {
+        erase(--end());
+    }
+
+    void pop_front() {
         erase(begin());
     }
-    AllocTraits::destroy(_alloc, _fake_node);
-    AllocTraits::deallocate(_alloc, static_cast<Node*>(_fake_node), 1);
-}
 
+    void clear();
+
+    template <typename... Args>
+    iterator emplace(const_iterator it, Args&&... args);
+    iterator insert(const_iterator it, const T& value);
+    iterator insert(const_iterator it, T&& value);
+    iterator erase(const_iterator it);
+
+    iterator end() {
+        return iterator(&_fake_node, 0);
+    }
+
+    iterator begin() {
+        return iterator(_fake_node.next, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(end_node(), 0);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(_fake_node.next, 0);
+    }
+
+    const_iterator cend() const {
+        return end();
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const {
+        return rbegin();
+    }
+
+    const_reverse_iterator crend() const {
+        return rend();
+    }
+
+private:
+    template <bool IsConst>
+    struct common_iterator {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = ConditionalValue<IsConst, const T*, T*>;
+        using reference = ConditionalValue<IsConst, const T&, T&>;
+        using iterator_category = std::bidirectional_iterator_tag;
+
+        common_iterator() = default;
+
+        common_iterator(BaseNode* node, size_t index)
+            : _node(node), _index(index) {}
+
+        common_iterator(const common_iterator<false>& other)
+            : _node(other.get_node()), _index(other.get_index()) {}
+
+        reference operator*() const {
+            return *static_cast<Node*>(_node)->slot(_index);
+        }
+
+        pointer operator->() const {
+            return static_cast<Node*>(_node)->slot(_index);
+        }
+
+        common_iterator& operator++() {
+            if (++_index == _node->count) {
+                _node = _node->next;
+                _index = 0;
+            }
+            return *this;
+        }
+
+        common_iterator operator++(int) {
+            common_iterator it = *this;
+            ++*this;
+            return it;
+        }
+
+        common_iterator& operator--() {
+            if (_index == 0) {
+                _node = _node->prev;
+                _index = _node->count;
+            }
+            --_index;
+            return *this;
+        }
+
+        common_iterator operator--(int) {
+            common_iterator it = *this;
+            --*this;
+            return it;
+        }
+
+        bool operator==(const common_iterator& rhs) const {
+            return _node == rhs._node && _index == rhs._index;
+        }
+
+        bool operator!=(const common_iterator& rhs) const {
+            return !(*this == rhs);
+        }
+
+        BaseNode* get_node() const {
+            return _node;
+        }
+
+        size_t get_index() const {
+            return _index;
+        }
+
+    private:
+        BaseNode* _node = nullptr;
+        size_t _index = 0;
+    };
+
+    using AllocTraits = std::allocator_traits<allocator_type>;
+
+    BaseNode* end_node() const {
+        return const_cast<BaseNode*>(&_fake_node);
+    }
+
+    Node* allocate_node();
+    void link_node(BaseNode* position, Node* node);
+    iterator emplace_node(BaseNode* position, T&& value);
+    void free_node(BaseNode* node);
+    void move_elements(Node* from, size_t first, Node* to);
+    void steal(UnrolledList& other);
+
+    allocator_type _alloc;
+    BaseNode _fake_node{&_fake_node, &_fake_node, 0};
+    size_t _list_size = 0;
+};
+
+template <typename T, typename Alloc, size_t NodeBytes>
+UnrolledList<T, Alloc, NodeBytes>::UnrolledList() = default;
+
+template <typename T, typename Alloc, size_t NodeBytes>
+UnrolledList<T, Alloc, NodeBytes>::UnrolledList(const Alloc& allocator)
+        : _alloc(allocator) {}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+UnrolledList<T, Alloc, NodeBytes>::UnrolledList(const UnrolledList& other)
+        : _alloc(AllocTraits::select_on_container_copy_construction(other._alloc)) {
+    try {
+        for (const T& value : other) {
+            emplace(end(), value);
+        }
+    } catch (...) {
+        clear();
+        throw;
+    }
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+UnrolledList<T, Alloc, NodeBytes>::UnrolledList(UnrolledList&& other) noexcept
+        : _alloc(other._alloc) {
+    steal(other);
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+UnrolledList<T, Alloc, NodeBytes>::~UnrolledList() {
+    clear();
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+UnrolledList<T, Alloc, NodeBytes>& UnrolledList<T, Alloc, NodeBytes>::operator=(const UnrolledList& other) {
+    if (&other != this) {
+        constexpr bool propagate = AllocTraits::propagate_on_container_copy_assignment::value;
+        UnrolledList copy{Alloc(propagate ? other._alloc : _alloc)};
+        for (const T& value : other) {
+            copy.emplace(copy.end(), value);
+        }
+        clear();
+        if constexpr (propagate) {
+            _alloc = other._alloc;
+        }
+        steal(copy);
+    }
+    return *this;
+}
+
+// Nodes can change hands only between equal allocators; otherwise the
+// values are moved into nodes of our own allocator.
+template <typename T, typename Alloc, size_t NodeBytes>
+UnrolledList<T, Alloc, NodeBytes>& UnrolledList<T, Alloc, NodeBytes>::operator=(UnrolledList&& other) noexcept(
+        std::allocator_traits<allocator_type>::propagate_on_container_move_assignment::value
+        || std::allocator_traits<allocator_type>::is_always_equal::value) {
+    if (&other != this) {
+        clear();
+        if constexpr (AllocTraits::propagate_on_container_move_assignment::value) {
+            _alloc = other._alloc;
+        }
+        if (_alloc == other._alloc) {
+            steal(other);
+        } else {
+            for (T& value : other) {
+                emplace(end(), std::move(value));
+            }
+        }
+    }
+    return *this;
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+void UnrolledList<T, Alloc, NodeBytes>::clear() {
+    while (_fake_node.next != &_fake_node) {
+        Node* node = static_cast<Node*>(_fake_node.next);
+        if constexpr (!std::is_trivially_destructible<T>::value) {
+            for (size_t i = 0; i < node->count; ++i) {
+                AllocTraits::destroy(_alloc, node->slot(i));
+            }
+        }
+        free_node(node);
+    }
+    _list_size = 0;
+}
+
+// Inserting at either end of a full node opens a new node next to it
+// instead of splitting, so push_back and push_front fill nodes completely.
+template <typename T, typename Alloc, size_t NodeBytes>
+template <typename... Args>
+typename UnrolledList<T, Alloc, NodeBytes>::iterator
+UnrolledList<T, Alloc, NodeBytes>::emplace(const_iterator it, Args&&... args) {
+    BaseNode* base = it.get_node();
+    size_t index = it.get_index();
+    if (base == &_fake_node || (index == 0 && base->prev != &_fake_node
+            && base->prev->count < NODE_CAPACITY)) {
+        base = base->prev;
+        index = base->count;
+    }
+    T value(std::forward<Args>(args)...);
+    if (base == &_fake_node || (base->count == NODE_CAPACITY && index == NODE_CAPACITY)) {
+        return emplace_node(base->next, std::move(value));
+    }
+    if (base->count == NODE_CAPACITY && index == 0) {
+        return emplace_node(base, std::move(value));
+    }
+    Node* node = static_cast<Node*>(base);
+    if (node->count == NODE_CAPACITY) {
+        size_t half = NODE_CAPACITY / 2;
+        Node* tail = allocate_node();
+        try {
+            move_elements(node, half, tail);
+        } catch (...) {
+            AllocTraits::deallocate(_alloc, tail, 1);
+            throw;
+        }
+        link_node(node->next, tail);
+        if (index > half) {
+            node = tail;
+            index -= half;
+        }
+    }
+    // The new last slot is counted as soon as it is built, so if a move
+    // below throws the node still holds only live elements.
+    if (index == node->count) {
+        AllocTraits::construct(_alloc, node->slot(index), std::move(value));
+        ++node->count;
+        ++_list_size;
+    } else {
+        AllocTraits::construct(_alloc, node->slot(node->count), std::move(*node->slot(node->count - 1)));
+        ++node->count;
+        ++_list_size;
+        std::move_backward(node->slot(index), node->slot(node->count - 2), node->slot(node->count - 1));
+        *node->slot(index) = std::move(value);
+    }
+    return iterator(node, index);
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+typename UnrolledList<T, Alloc, NodeBytes>::iterator
+UnrolledList<T, Alloc, NodeBytes>::insert(const_iterator it, const T& value) {
+    return emplace(it, value);
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+typename UnrolledList<T, Alloc, NodeBytes>::iterator
+UnrolledList<T, Alloc, NodeBytes>::insert(const_iterator it, T&& value) {
+    return emplace(it, std::move(value));
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+typename UnrolledList<T, Alloc, NodeBytes>::iterator
+UnrolledList<T, Alloc, NodeBytes>::erase(const_iterator it) {
+    Node* node = static_cast<Node*>(it.get_node());
+    size_t index = it.get_index();
+    std::move(node->slot(index + 1), node->slot(node->count), node->slot(index));
+    AllocTraits::destroy(_alloc, node->slot(node->count - 1));
+    --node->count;
+    --_list_size;
+    if (node->count == 0) {
+        BaseNode* next = node->next;
+        free_node(node);
+        return iterator(next, 0);
+    }
+    // Merging is skipped when moving elements could throw, so that erase
+    // itself does not.
+    BaseNode* next = node->next;
+    if (std::is_nothrow_move_constructible<T>::value
+            && node->count < NODE_CAPACITY / 2 && next != &_fake_node
+            && node->count + next->count <= NODE_CAPACITY) {
+        move_elements(static_cast<Node*>(next), 0, node);
+        free_node(next);
+    }
+    if (index == node->count) {
+        return iterator(node->next, 0);
+    }
+    return iterator(node, index);
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+typename UnrolledList<T, Alloc, NodeBytes>::Node*
+UnrolledList<T, Alloc, NodeBytes>::allocate_node() {
+    Node* node = AllocTraits::allocate(_alloc, 1);
+    node->count = 0;
+    return node;
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+void UnrolledList<T, Alloc, NodeBytes>::link_node(BaseNode* position, Node* node) {
+    node->prev = position->prev;
+    node->next = position;
+    position->prev->next = node;
+    position->prev = node;
+}
+
+// The element is built in a detached node, which is linked in only once it
+// holds a live element.
+template <typename T, typename Alloc, size_t NodeBytes>
+typename UnrolledList<T, Alloc, NodeBytes>::iterator
+UnrolledList<T, Alloc, NodeBytes>::emplace_node(BaseNode* position, T&& value) {
+    Node* node = allocate_node();
+    try {
+        AllocTraits::construct(_alloc, node->slot(0), std::move(value));
+    } catch (...) {
+        AllocTraits::deallocate(_alloc, node, 1);
+        throw;
+    }
+    node->count = 1;
+    link_node(position, node);
+    ++_list_size;
+    return iterator(node, 0);
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+void UnrolledList<T, Alloc, NodeBytes>::free_node(BaseNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    AllocTraits::deallocate(_alloc, static_cast<Node*>(node), 1);
+}
+
+// Moves the elements of from starting at first onto the end of to. All of
+// them are built in to before any is destroyed in from, with copies when a
+// move could throw, so on a throw the new ones are destroyed and both nodes
+// are left as they were.
+template <typename T, typename Alloc, size_t NodeBytes>
+void UnrolledList<T, Alloc, NodeBytes>::move_elements(Node* from, size_t first, Node* to) {
+    size_t count = from->count - first;
+    size_t built = 0;
+    try {
+        for (; built < count; ++built) {
+            AllocTraits::construct(_alloc, to->slot(to->count + built),
+                                   std::move_if_noexcept(*from->slot(first + built)));
+        }
+    } catch (...) {
+        for (size_t i = 0; i < built; ++i) {
+            AllocTraits::destroy(_alloc, to->slot(to->count + i));
+        }
+        throw;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        AllocTraits::destroy(_alloc, from->slot(first + i));
+    }
+    to->count += count;
+    from->count = first;
+}
+
+template <typename T, typename Alloc, size_t NodeBytes>
+void UnrolledList<T, Alloc, NodeBytes>::steal(UnrolledList& other) {
+    if (other._fake_node.next == &other._fake_node) {
+        return;
+    }
+    _fake_node.next = other._fake_node.next;
+    _fake_node.prev = other._fake_node.prev;
+    _fake_node.next->prev = &_fake_node;
+    _fake_node.prev->next = &_fake_node;
+    _list_size = other._list_size;
+    other._fake_node.next = &other._fake_node;
+    other._fake_node.prev = &other._fake_node;
+    other._list_size = 0;
+}
+
+
+// Hook an element inherits to live in an IntrusiveList; Tag tells apart the
+// hooks of an element kept in several lists at once. An unlinked hook has
+// null pointers, and an element must be removed from its list before it is
+// destroyed. Copying an element does not copy its list membership.
+template <typename Tag = void>
+struct ListHook {
+    ListHook* prev = nullptr;
+    ListHook* next = nullptr;
+
+    ListHook() = default;
+    ListHook(ListHook* prev_hook, ListHook* next_hook): prev(prev_hook), next(next_hook) {}
+    ListHook(const ListHook&) {}
+
+    ListHook& operator=(const ListHook&) {
+        return *this;
+    }
+
+    bool is_linked() const {
+        return next != nullptr;
+    }
+};
+
+// List of elements owned elsewhere: the nodes are the elements' own hooks,
+// so linking and unlinking never allocate or copy, and an element can be
+// removed in O(1) given only a reference to it. Same sentinel layout as
+// List.
+template <typename T, typename Tag = void>
+class IntrusiveList {
+private:
+    template <bool IsConst>
+    struct common_iterator;
+
+    using Hook = ListHook<Tag>;
+
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using iterator = common_iterator<false>;
+    using const_iterator = common_iterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    IntrusiveList() = default;
+    IntrusiveList(const IntrusiveList&) = delete;
+    IntrusiveList(IntrusiveList&& other) noexcept;
+    ~IntrusiveList();
+    IntrusiveList& operator=(const IntrusiveList&) = delete;
+    IntrusiveList& operator=(IntrusiveList&& other) noexcept;
+
+    bool empty() const {
+        return !(_list_size);
+    }
+
+    size_t size() const {
+        return _list_size;
+    }
+
+    T& front() {
+        return *begin();
+    }
+
+    const T& front() const {
+        return *begin();
+    }
+
+    T& back() {
+        return *--end();
+    }
+
+    const T& back() const {
+        return *--end();
+    }
+
+    void push_back(T& value) {
+        insert(end(), value);
+    }
+
+    void push_front(T& value) {
+        insert(begin(), value);
+    }
+
+    void pop_back() {
+        erase(--end());
+    }
+
+    void pop_front() {
+        erase(begin());
+    }
+
+    void clear();
+
+    iterator insert(const_iterator it, T& value);
+    iterator erase(const_iterator it);
+    void remove(T& value);
+    void splice(const_iterator it, IntrusiveList& other);
+    void splice(const_iterator it, IntrusiveList& other, const_iterator element);
+
+    iterator iterator_to(T& value) {
+        return iterator(static_cast<Hook*>(&value));
+    }
+
+    const_iterator iterator_to(const T& value) const {
+        return const_iterator(const_cast<Hook*>(static_cast<const Hook*>(&value)));
+    }
+
+    iterator end() {
+        return iterator(&_fake_node);
+    }
+
+    iterator begin() {
+        return iterator(_fake_node.next);
+    }
+
+    const_iterator end() const {
+        return const_iterator(end_node());
+    }
+
+    const_iterator begin() const {
+        return const_iterator(_fake_node.next);
+    }
+
+    const_iterator cend() const {
+        return end();
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const {
+        return rbegin();
+    }
+
+    const_reverse_iterator crend() const {
+        return rend();
+    }
+
+private:
+    template <bool IsConst>
+    struct common_iterator {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = ConditionalValue<IsConst, const T*, T*>;
+        using reference = ConditionalValue<IsConst, const T&, T&>;
+        using iterator_category = std::bidirectional_iterator_tag;
+
+        common_iterator() = default;
+
+        explicit common_iterator(Hook* node)
+            : _node(node) {}
+
+        common_iterator(const common_iterator<false>& other)
+            : _node(other.get_node()) {}
+
+        reference operator*() const {
+            return *static_cast<pointer>(_node);
+        }
+
+        pointer operator->() const {
+            return static_cast<pointer>(_node);
+        }
+
+        common_iterator& operator++() {
+            _node = _node->next;
+            return *this;
+        }
+
+        common_iterator operator++(int) {
+            common_iterator it(_node);
+            _node = _node->next;
+            return it;
+        }
+
+        common_iterator& operator--() {
+            _node = _node->prev;
+            return *this;
+        }
+
+        common_iterator operator--(int) {
+            common_iterator it(_node);
+            _node = _node->prev;
+            return it;
+        }
+
+        bool operator==(const common_iterator& rhs) const {
+            return _node == rhs._node;
+        }
+
+        bool operator!=(const common_iterator& rhs) const {
+            return _node != rhs._node;
+        }
+
+        Hook* get_node() const {
+            return _node;
+        }
+
+    private:
+        Hook* _node = nullptr;
+    };
+
+    Hook* end_node() const {
+        return const_cast<Hook*>(&_fake_node);
+    }
+
+    static void unlink(Hook* node);
+    void steal(IntrusiveList& other);
+
+    Hook _fake_node{&_fake_node, &_fake_node};
+    size_t _list_size = 0;
+};
+
+template <typename T, typename Tag>
+IntrusiveList<T, Tag>::IntrusiveList(IntrusiveList&& other) noexcept {
+    steal(other);
+}
+
+template <typename T, typename Tag>
+IntrusiveList<T, Tag>::~IntrusiveList() {
+    clear();
+}
+
+template <typename T, typename Tag>
+IntrusiveList<T, Tag>& IntrusiveList<T, Tag>::operator=(IntrusiveList&& other) noexcept {
+    if (&other != this) {
+        clear();
+        steal(other);
+    }
+    return *this;
+}
+
+template <typename T, typename Tag>
+void IntrusiveList<T, Tag>::clear() {
+    for (Hook* node = _fake_node.next; node != &_fake_node;) {
+        Hook* next = node->next;
+        node->prev = nullptr;
+        node->next = nullptr;
+        node = next;
+    }
+    _fake_node.prev = &_fake_node;
+    _fake_node.next = &_fake_node;
+    _list_size = 0;
+}
+
+template <typename T, typename Tag>
+typename IntrusiveList<T, Tag>::iterator IntrusiveList<T, Tag>::insert(const_iterator it, T& value) {
+    Hook* node = static_cast<Hook*>(&value);
+    Hook* position = it.get_node();
+    node->prev = position->prev;
+    node->next = position;
+    position->prev->next = node;
+    position->prev = node;
+    ++_list_size;
+    return iterator(node);
+}
+
+template <typename T, typename Tag>
+typename IntrusiveList<T, Tag>::iterator IntrusiveList<T, Tag>::erase(const_iterator it) {
+    Hook* next = it.get_node()->next;
+    unlink(it.get_node());
+    --_list_size;
+    return iterator(next);
+}
+
+// value must be linked into this list.
+template <typename T, typename Tag>
+void IntrusiveList<T, Tag>::remove(T& value) {
+    unlink(static_cast<Hook*>(&value));
+    --_list_size;
+}
+
+template <typename T, typename Tag>
+void IntrusiveList<T, Tag>::splice(const_iterator it, IntrusiveList& other) {
+    if (&other == this || other.empty()) {
+        return;
+    }
+    Hook* position = it.get_node();
+    Hook* first = other._fake_node.next;
+    Hook* last = other._fake_node.prev;
+    first->prev = position->prev;
+    last->next = position;
+    position->prev->next = first;
+    position->prev = last;
+    _list_size += other._list_size;
+    other._fake_node.prev = &other._fake_node;
+    other._fake_node.next = &other._fake_node;
+    other._list_size = 0;
+}
+
+// Moving an element within one list, e.g. to the front of an LRU list, is
+// splice(begin(), *this, iterator_to(element)).
+template <typename T, typename Tag>
+void IntrusiveList<T, Tag>::splice(const_iterator it, IntrusiveList& other, const_iterator element) {
+    Hook* node = element.get_node();
+    Hook* position = it.get_node();
+    if (position == node || position == node->next) {
+        return;
+    }
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = position->prev;
+    node->next = position;
+    position->prev->next = node;
+    position->prev = node;
+    --other._list_size;
+    ++_list_size;
+}
+
+template <typename T, typename Tag>
+void IntrusiveList<T, Tag>::unlink(Hook* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = nullptr;
+    node->next = nullptr;
+}
+
+template <typename T, typename Tag>
+void IntrusiveList<T, Tag>::steal(IntrusiveList& other) {
+    if (other.empty()) {
+        return;
+    }
+    _fake_node.next = other._fake_node.next;
+    _fake_node.prev = other._fake_node.prev;
+    _fake_node.next->prev = &_fake_node;
+    _fake_node.prev->next = &_fake_node;
+    _list_size = other._list_size;
+    other._fake_node.next = &other._fake_node;
+    other._fake_node.prev = &other._fake_node;
+    other._list_size = 0;
+}
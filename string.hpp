@@ -1,5 +1,368 @@
 #include <iostream>
 #include <cstring>
+#include <cstdint>
+#include <compare>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+class StringSearch {
+public:
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+    static size_t find(const char* text, size_t text_size,
+                       const char* pattern, size_t pattern_size, size_t pos);
+    static size_t rfind(const char* text, size_t text_size,
+                        const char* pattern, size_t pattern_size, size_t pos);
+
+private:
+    // Patterns up to this length are matched by first/last byte filtering,
+    // longer ones by Horspool, whose skip table pays off with the length.
+    static const size_t SHORT_PATTERN = 32;
+
+    static size_t find_short(const char*, size_t, const char*, size_t);
+    static size_t find_simd(const char*, size_t, const char*, size_t);
+    static size_t find_horspool(const char*, size_t, const char*, size_t);
+    static size_t rfind_short(const char*, size_t, const char*, size_t);
+    static size_t rfind_horspool(const char*, size_t, const char*, size_t);
+};
+
+
+inline size_t StringSearch::find(const char* text, size_t text_size,
+                          const char* pattern, size_t pattern_size,
+                          size_t pos) {
+    if (pos > text_size || pattern_size > text_size - pos) return NOT_FOUND;
+    if (pattern_size == 0) return pos;
+
+    const char* begin = text + pos;
+    size_t size = text_size - pos;
+    size_t index;
+    if (pattern_size == 1) {
+        const void* found = memchr(begin, pattern[0], size);
+        return found ? static_cast<const char*>(found) - text : NOT_FOUND;
+    } else if (pattern_size <= SHORT_PATTERN) {
+        index = find_simd(begin, size, pattern, pattern_size);
+    } else {
+        index = find_horspool(begin, size, pattern, pattern_size);
+    }
+    return index == NOT_FOUND ? NOT_FOUND : index + pos;
+}
+
+inline size_t StringSearch::rfind(const char* text, size_t text_size,
+                           const char* pattern, size_t pattern_size,
+                           size_t pos) {
+    if (pattern_size > text_size) return NOT_FOUND;
+    size_t size = std::min(pos, text_size - pattern_size) + pattern_size;
+    if (pattern_size == 0) return size;
+    if (pattern_size <= SHORT_PATTERN) {
+        return rfind_short(text, size, pattern, pattern_size);
+    }
+    return rfind_horspool(text, size, pattern, pattern_size);
+}
+
+inline size_t StringSearch::find_short(const char* text, size_t text_size,
+                                const char* pattern, size_t pattern_size) {
+    const char* last = text + text_size - pattern_size + 1;
+    for (const char* it = text; it < last; ++it) {
+        it = static_cast<const char*>(memchr(it, pattern[0], last - it));
+        if (it == nullptr) break;
+        if (memcmp(it + 1, pattern + 1, pattern_size - 1) == 0) {
+            return it - text;
+        }
+    }
+    return NOT_FOUND;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// Compares the first and the last pattern byte against a whole register of
+// candidate positions at once and runs memcmp only where both of them match.
+inline size_t StringSearch::find_simd(const char* text, size_t text_size,
+                               const char* pattern, size_t pattern_size) {
+#if defined(__AVX2__)
+    using Register = __m256i;
+    const Register first = _mm256_set1_epi8(pattern[0]);
+    const Register last = _mm256_set1_epi8(pattern[pattern_size - 1]);
+#else
+    using Register = __m128i;
+    const Register first = _mm_set1_epi8(pattern[0]);
+    const Register last = _mm_set1_epi8(pattern[pattern_size - 1]);
+#endif
+    const size_t width = sizeof(Register);
+    size_t i = 0;
+    for (; i + pattern_size - 1 + width <= text_size; i += width) {
+        const char* block = text + i;
+#if defined(__AVX2__)
+        Register block_first = _mm256_loadu_si256(
+            reinterpret_cast<const Register*>(block));
+        Register block_last = _mm256_loadu_si256(
+            reinterpret_cast<const Register*>(block + pattern_size - 1));
+        uint32_t mask = _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                             _mm256_cmpeq_epi8(last, block_last)));
+#else
+        Register block_first = _mm_loadu_si128(
+            reinterpret_cast<const Register*>(block));
+        Register block_last = _mm_loadu_si128(
+            reinterpret_cast<const Register*>(block + pattern_size - 1));
+        uint32_t mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                          _mm_cmpeq_epi8(last, block_last)));
+#endif
+        while (mask) {
+            size_t bit = __builtin_ctz(mask);
+            if (memcmp(block + bit + 1, pattern + 1, pattern_size - 2) == 0) {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    size_t index = find_short(text + i, text_size - i, pattern, pattern_size);
+    return index == NOT_FOUND ? NOT_FOUND : index + i;
+}
+#else
+inline size_t StringSearch::find_simd(const char* text, size_t text_size,
+                               const char* pattern, size_t pattern_size) {
+    return find_short(text, text_size, pattern, pattern_size);
+}
+#endif
+
+inline size_t StringSearch::find_horspool(const char* text, size_t text_size,
+                                   const char* pattern, size_t pattern_size) {
+    size_t shift[256];
+    for (size_t c = 0; c < 256; ++c) {
+        shift[c] = pattern_size;
+    }
+    for (size_t i = 0; i < pattern_size - 1; ++i) {
+        shift[static_cast<unsigned char>(pattern[i])] = pattern_size - 1 - i;
+    }
+
+    const char last = pattern[pattern_size - 1];
+    for (size_t i = 0; i + pattern_size <= text_size;) {
+        char c = text[i + pattern_size - 1];
+        if (c == last && memcmp(text + i, pattern, pattern_size - 1) == 0) {
+            return i;
+        }
+        i += shift[static_cast<unsigned char>(c)];
+    }
+    return NOT_FOUND;
+}
+
+inline size_t StringSearch::rfind_short(const char* text, size_t text_size,
+                                 const char* pattern, size_t pattern_size) {
+    for (size_t i = text_size - pattern_size + 1; i-- > 0;) {
+        if (text[i] == pattern[0] &&
+            memcmp(text + i + 1, pattern + 1, pattern_size - 1) == 0) {
+            return i;
+        }
+    }
+    return NOT_FOUND;
+}
+
+inline size_t StringSearch::rfind_horspool(const char* text, size_t text_size,
+                                    const char* pattern, size_t pattern_size) {
+    size_t shift[256];
+    for (size_t c = 0; c < 256; ++c) {
+        shift[c] = pattern_size;
+    }
+    for (size_t i = pattern_size - 1; i > 0; --i) {
+        shift[static_cast<unsigned char>(pattern[i])] = i;
+    }
+
+    const char first = pattern[0];
+    for (size_t i = text_size - pattern_size;;) {
+        char c = text[i];
+        if (c == first && memcmp(text + i + 1, pattern + 1,
+                                 pattern_size - 1) == 0) {
+            return i;
+        }
+        size_t step = shift[static_cast<unsigned char>(c)];
+        if (i < step) break;
+        i -= step;
+    }
+    return NOT_FOUND;
+}
+
+
+
+template <typename Delimiter>
+class SplitRange;
+struct CharDelimiter;
+struct StringDelimiter;
+struct WhitespaceDelimiter;
+
+
+
+class StringView {
+public:
+    StringView();
+    StringView(const char*);
+    StringView(const char*, size_t);
+
+    size_t length() const;
+    bool empty() const;
+    const char* data() const;
+    const char* begin() const;
+    const char* end() const;
+
+    size_t find(StringView) const;
+    size_t find(StringView, size_t) const;
+    size_t rfind(StringView) const;
+    size_t rfind(StringView, size_t) const;
+    std::vector<size_t> find_all(StringView) const;
+    StringView substr(size_t, size_t) const;
+    bool starts_with(StringView) const;
+    bool ends_with(StringView) const;
+    SplitRange<CharDelimiter> split(char) const;
+    SplitRange<StringDelimiter> split(StringView) const;
+    SplitRange<WhitespaceDelimiter> tokenize() const;
+    void remove_prefix(size_t);
+    void remove_suffix(size_t);
+    char front() const;
+    char back() const;
+
+    char operator[](size_t) const;
+
+private:
+    const char* viewData = nullptr;
+    size_t viewSize = 0;
+};
+
+
+
+inline StringView::StringView(): viewData("") {}
+
+inline StringView::StringView(const char* cstyle_string): viewData(cstyle_string),
+                                                          viewSize(strlen(cstyle_string)) {}
+
+inline StringView::StringView(const char* data, size_t size): viewData(data),
+                                                              viewSize(size) {}
+
+
+
+inline size_t StringView::length() const {
+    return viewSize;
+}
+
+inline bool StringView::empty() const {
+    return viewSize == 0;
+}
+
+inline const char* StringView::data() const {
+    return viewData;
+}
+
+inline const char* StringView::begin() const {
+    return viewData;
+}
+
+inline const char* StringView::end() const {
+    return viewData + viewSize;
+}
+
+
+
+inline size_t StringView::find(StringView substring) const {
+    return find(substring, 0);
+}
+
+inline size_t StringView::find(StringView substring, size_t pos) const {
+    size_t index = StringSearch::find(viewData, viewSize, substring.viewData,
+                                      substring.viewSize, pos);
+    return index == StringSearch::NOT_FOUND ? viewSize : index;
+}
+
+inline size_t StringView::rfind(StringView substring) const {
+    return rfind(substring, viewSize);
+}
+
+inline size_t StringView::rfind(StringView substring, size_t pos) const {
+    size_t index = StringSearch::rfind(viewData, viewSize, substring.viewData,
+                                       substring.viewSize, pos);
+    return index == StringSearch::NOT_FOUND ? viewSize : index;
+}
+
+inline std::vector<size_t> StringView::find_all(StringView substring) const {
+    std::vector<size_t> indexes;
+    size_t index = StringSearch::find(viewData, viewSize, substring.viewData,
+                                      substring.viewSize, 0);
+    while (index != StringSearch::NOT_FOUND) {
+        indexes.push_back(index);
+        index = StringSearch::find(viewData, viewSize, substring.viewData,
+                                   substring.viewSize, index + 1);
+    }
+    return indexes;
+}
+
+inline StringView StringView::substr(size_t start, size_t count) const {
+    start = std::min(start, viewSize);
+    return StringView(viewData + start, std::min(count, viewSize - start));
+}
+
+inline bool StringView::starts_with(StringView prefix) const {
+    return prefix.viewSize <= viewSize &&
+           memcmp(viewData, prefix.viewData, prefix.viewSize) == 0;
+}
+
+inline bool StringView::ends_with(StringView suffix) const {
+    return suffix.viewSize <= viewSize &&
+           memcmp(viewData + viewSize - suffix.viewSize, suffix.viewData,
+                  suffix.viewSize) == 0;
+}
+
+inline void StringView::remove_prefix(size_t count) {
+    viewData += count;
+    viewSize -= count;
+}
+
+inline void StringView::remove_suffix(size_t count) {
+    viewSize -= count;
+}
+
+inline char StringView::front() const {
+    return viewData[0];
+}
+
+inline char StringView::back() const {
+    return viewData[viewSize - 1];
+}
+
+
+
+inline char StringView::operator[](size_t index) const {
+    return viewData[index];
+}
+
+
+
+// Most unequal keys already differ in length or in the first machine word,
+// so those are checked before handing the rest to memcmp.
+inline bool operator==(StringView lhs, StringView rhs) {
+    size_t size = lhs.length();
+    if (size != rhs.length()) return false;
+    if (size >= sizeof(uint64_t)) {
+        uint64_t lhs_word;
+        uint64_t rhs_word;
+        memcpy(&lhs_word, lhs.data(), sizeof(uint64_t));
+        memcpy(&rhs_word, rhs.data(), sizeof(uint64_t));
+        if (lhs_word != rhs_word) return false;
+    }
+    return memcmp(lhs.data(), rhs.data(), size) == 0;
+}
+
+inline std::strong_ordering operator<=>(StringView lhs, StringView rhs) {
+    int result = memcmp(lhs.data(), rhs.data(),
+                        std::min(lhs.length(), rhs.length()));
+    if (result != 0) return result <=> 0;
+    return lhs.length() <=> rhs.length();
+}
+
 
 
 class String {
@@ -7,33 +370,56 @@ public:
     String();
     String(const char*);
     String(size_t, char);
+    explicit String(StringView);
     String(const String&);
+    String(String&&);
+    explicit String(std::pmr::memory_resource*);
+    String(const char*, std::pmr::memory_resource*);
+    String(StringView, std::pmr::memory_resource*);
+    String(const String&, std::pmr::memory_resource*);
     ~String();
 
+    operator StringView() const;
+    std::pmr::memory_resource* get_resource() const;
+
     size_t length() const;
     bool empty() const;
     void push_back(char);
     void pop_back(); 
     void clear();
 
-    size_t find(const String&) const;
-    size_t rfind(const String&) const;
+    const char* data() const;
+    size_t find(StringView) const;
+    size_t find(StringView, size_t) const;
+    size_t rfind(StringView) const;
+    size_t rfind(StringView, size_t) const;
+    std::vector<size_t> find_all(StringView) const;
     String substr(size_t, size_t) const;
+    StringView view(size_t, size_t) const;
+    bool starts_with(StringView) const;
+    bool ends_with(StringView) const;
+    SplitRange<CharDelimiter> split(char) const;
+    SplitRange<StringDelimiter> split(StringView) const;
+    SplitRange<WhitespaceDelimiter> tokenize() const;
     char& front();
     char front() const;
     char& back();
     char back() const;    
 
-    bool operator==(const String&) const;
     String& operator=(const String&);
+    String& operator=(String&&);
     char& operator[](size_t);
     char operator[](size_t) const;
-    String& operator+=(const String&);
+    String& operator+=(StringView);
     String& operator+=(char);
 
 private:
     void swap(String&);
     void grow_buffer();
+    void append(const char*, size_t);
+    char* allocate(size_t);
+    void deallocate(char*, size_t);
+    std::pmr::memory_resource* memoryResource = std::pmr::get_default_resource();
     size_t stringSize = 0;
     size_t bufferSize = 0;
     char* string = nullptr;
@@ -41,27 +427,70 @@ private:
 
 
 
-String::String(): bufferSize(1), string(new char[bufferSize]) {}
+String::String(): bufferSize(1), string(allocate(bufferSize)) {}
 
 String::String(const char* cstyle_string): stringSize(strlen(cstyle_string)), 
                                            bufferSize(stringSize), 
-                                           string(new char[bufferSize]) {
+                                           string(allocate(bufferSize)) {
     memcpy(string, cstyle_string, stringSize);
 }
 
 String::String(size_t n, char symbol): stringSize(n), bufferSize(n),
-string(new char[n]) {
+string(allocate(n)) {
     memset(string, symbol, n);
 }
 
+String::String(StringView view): stringSize(view.length()),
+                                 bufferSize(stringSize),
+                                 string(allocate(bufferSize)) {
+    memcpy(string, view.data(), stringSize);
+}
+
 String::String(const String& old_string): stringSize(old_string.stringSize),
                                            bufferSize(stringSize),
-                                           string(new char[bufferSize]) {
-    memcpy(string, old_string.string, stringSize);
+                                           string(allocate(bufferSize)) {
+    if (stringSize) {
+        memcpy(string, old_string.string, stringSize);
+    }
+}
+
+String::String(String&& old_string): memoryResource(old_string.memoryResource),
+                                      stringSize(old_string.stringSize),
+                                      bufferSize(old_string.bufferSize),
+                                      string(old_string.string) {
+    old_string.stringSize = 0;
+    old_string.bufferSize = 0;
+    old_string.string = nullptr;
+}
+
+String::String(std::pmr::memory_resource* resource): memoryResource(resource),
+                                                     bufferSize(1),
+                                                     string(allocate(bufferSize)) {}
+
+String::String(const char* cstyle_string, std::pmr::memory_resource* resource)
+    : String(StringView(cstyle_string), resource) {}
+
+String::String(StringView view, std::pmr::memory_resource* resource)
+    : memoryResource(resource), stringSize(view.length()),
+      bufferSize(stringSize), string(allocate(bufferSize)) {
+    if (stringSize) {
+        memcpy(string, view.data(), stringSize);
+    }
 }
 
+String::String(const String& old_string, std::pmr::memory_resource* resource)
+    : String(StringView(old_string), resource) {}
+
 String::~String() {
-    delete[] string;
+    deallocate(string, bufferSize);
+}
+
+String::operator StringView() const {
+    return StringView(string, stringSize);
+}
+
+std::pmr::memory_resource* String::get_resource() const {
+    return memoryResource;
 }
 
 
@@ -91,40 +520,44 @@ void String::clear() {
 
 
 
-size_t String::find(const String& substring) const {
-    for (size_t i = 0; i < stringSize; ++i) {
-        size_t index = i;
-        for (size_t j = 0; j < substring.stringSize; ++j) {
-            if (string[index] != substring[j]) break;
-            if (j == substring.stringSize - 1) {
-                return i;
-            }
-            ++index;
-        }
-    }
-    return stringSize;
+const char* String::data() const {
+    return string;
 }
 
-size_t String::rfind(const String& substring) const {
-    for (size_t i = 0; i < stringSize; ++i) {
-        size_t index = stringSize - i - 1;
-        for (size_t j = 0; j < substring.stringSize; ++j) {
-            if (string[index] != substring[substring.stringSize - j - 1]) break;
-            if (j == substring.stringSize - 1) {
-                return stringSize - i - substring.stringSize;
-            }
-            --index;
-        }
-    }
-    return stringSize;
-}   
+size_t String::find(StringView substring) const {
+    return StringView(*this).find(substring);
+}
+
+size_t String::find(StringView substring, size_t pos) const {
+    return StringView(*this).find(substring, pos);
+}
+
+size_t String::rfind(StringView substring) const {
+    return StringView(*this).rfind(substring);
+}
+
+size_t String::rfind(StringView substring, size_t pos) const {
+    return StringView(*this).rfind(substring, pos);
+}
+
+std::vector<size_t> String::find_all(StringView substring) const {
+    return StringView(*this).find_all(substring);
+}
 
 String String::substr(size_t start, size_t count) const {
-    String new_string;
-    for (size_t i = start; i < start + count; ++i) {
-        new_string += string[i];
-    }
-    return new_string;
+    return String(view(start, count), memoryResource);
+}
+
+StringView String::view(size_t start, size_t count) const {
+    return StringView(*this).substr(start, count);
+}
+
+bool String::starts_with(StringView prefix) const {
+    return StringView(*this).starts_with(prefix);
+}
+
+bool String::ends_with(StringView suffix) const {
+    return StringView(*this).ends_with(suffix);
 }
 
 char& String::front() {
@@ -145,22 +578,24 @@ char String::back() const {
 
 
 
-bool String::operator==(const String& equal_string) const {
-    if (stringSize == equal_string.stringSize) {
-        for (size_t i = 0; i < stringSize; ++i) {
-            if (string[i] != equal_string[i]) break;
-            if (i == stringSize - 1) return true;
-        }
-    }
-    return false;
-}
-
+// Assignment never changes the resource a string allocates from, so a
+// string that lives in an arena keeps its characters there.
 String& String::operator=(const String& new_string) {
-    String copy_string = new_string;
+    String copy_string(new_string, memoryResource);
     swap(copy_string);
     return *this;
 }
 
+String& String::operator=(String&& new_string) {
+    if (memoryResource->is_equal(*new_string.memoryResource)) {
+        swap(new_string);
+    } else {
+        String copy_string(new_string, memoryResource);
+        swap(copy_string);
+    }
+    return *this;
+}
+
 char& String::operator[](size_t index) {
     return string[index];
 }
@@ -169,10 +604,8 @@ char String::operator[](size_t index) const {
     return string[index];
 }
 
-String& String::operator+=(const String& new_string) {
-    for (size_t i = 0; i < new_string.stringSize; ++i) {
-        push_back(new_string[i]);
-    }
+String& String::operator+=(StringView new_string) {
+    append(new_string.data(), new_string.length());
     return *this;
 }
 
@@ -184,38 +617,202 @@ String& String::operator+=(char c) {
 
 
 void String::swap (String& copy_string) {
+    std::swap(copy_string.memoryResource, memoryResource);
     std::swap(copy_string.stringSize, stringSize);
     std::swap(copy_string.string, string);
     std::swap(copy_string.bufferSize, bufferSize);
 }
 
 void String::grow_buffer() {
-    bufferSize *= 2;
-    char* new_string = new char[bufferSize];
-    memcpy(new_string, string, stringSize);
-    delete[] string;
+    size_t old_size = bufferSize;
+    bufferSize = bufferSize ? bufferSize * 2 : 1;
+    char* new_string = allocate(bufferSize);
+    if (stringSize) {
+        memcpy(new_string, string, stringSize);
+    }
+    deallocate(string, old_size);
     string = new_string;
 }
 
+// The appended bytes may live inside this very string, so the old buffer is
+// released only after they have been copied.
+void String::append(const char* data, size_t count) {
+    if (stringSize + count > bufferSize) {
+        size_t new_size = std::max(bufferSize * 2, stringSize + count);
+        char* new_string = allocate(new_size);
+        if (stringSize) {
+            memcpy(new_string, string, stringSize);
+        }
+        memcpy(new_string + stringSize, data, count);
+        deallocate(string, bufferSize);
+        string = new_string;
+        bufferSize = new_size;
+    } else {
+        memcpy(string + stringSize, data, count);
+    }
+    stringSize += count;
+}
+
+char* String::allocate(size_t size) {
+    return static_cast<char*>(memoryResource->allocate(size, alignof(char)));
+}
+
+void String::deallocate(char* buffer, size_t size) {
+    if (buffer) {
+        memoryResource->deallocate(buffer, size, alignof(char));
+    }
+}
+
+
+
+// Lets any allocator with the usual rebind and allocator_traits interface,
+// StackAllocator included, serve as the memory resource of a String.
+template <typename Alloc>
+class AllocatorResource: public std::pmr::memory_resource {
+public:
+    explicit AllocatorResource(const Alloc& allocator = Alloc())
+        : _alloc(allocator) {}
+
+private:
+    using Unit = std::max_align_t;
+    using UnitAllocator =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<Unit>;
+    using AllocTraits = std::allocator_traits<UnitAllocator>;
+
+    static size_t units(size_t bytes) {
+        return std::max<size_t>(1, (bytes + sizeof(Unit) - 1) / sizeof(Unit));
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        if (alignment > alignof(Unit)) {
+            throw std::bad_alloc();
+        }
+        return AllocTraits::allocate(_alloc, units(bytes));
+    }
+
+    void do_deallocate(void* pointer, size_t bytes, size_t) override {
+        AllocTraits::deallocate(_alloc, static_cast<Unit*>(pointer), units(bytes));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        const AllocatorResource* resource =
+            dynamic_cast<const AllocatorResource*>(&other);
+        return resource != nullptr && resource->_alloc == _alloc;
+    }
+
+    UnitAllocator _alloc;
+};
+
+
+
+// std::streambuf keeps its get area protected. Naming the members through a
+// derived class lets the readers below scan buffered characters in place and
+// append whole runs of them at once instead of extracting them one by one.
+class StreamBufferAccess: public std::streambuf {
+public:
+    static StringView get_area(std::streambuf* buffer) {
+        const char* begin = (buffer->*&StreamBufferAccess::gptr)();
+        const char* end = (buffer->*&StreamBufferAccess::egptr)();
+        return begin < end ? StringView(begin, end - begin) : StringView();
+    }
+
+    static void skip(std::streambuf* buffer, size_t count) {
+        (buffer->*&StreamBufferAccess::gbump)(static_cast<int>(count));
+    }
+};
+
+// The characters std::isspace accepts in the "C" locale.
+inline bool is_ascii_space(char c) {
+    return c == ' ' || static_cast<unsigned char>(c - '\t') < 5;
+}
+
+std::istream& operator>>(std::istream& in, String& string) {
+    string.clear();
+    std::istream::sentry sentry(in);
+    if (!sentry) return in;
+
+    std::streambuf* buffer = in.rdbuf();
+    std::ios_base::iostate state = std::ios_base::goodbit;
+    while (true) {
+        StringView area = StreamBufferAccess::get_area(buffer);
+        if (area.empty()) {
+            int c = buffer->sgetc();
+            if (c == std::char_traits<char>::eof()) {
+                state |= std::ios_base::eofbit;
+                break;
+            }
+            if (is_ascii_space(c)) break;
+            area = StreamBufferAccess::get_area(buffer);
+            if (area.empty()) {
+                string.push_back(c);
+                buffer->sbumpc();
+                continue;
+            }
+        }
 
+        size_t count = 0;
+        while (count < area.length() && !is_ascii_space(area[count])) ++count;
+        string += area.substr(0, count);
+        StreamBufferAccess::skip(buffer, count);
+        if (count < area.length()) break;
+    }
+    if (string.empty()) {
+        state |= std::ios_base::failbit;
+    }
+    in.setstate(state);
+    return in;
+}
 
-std::istream& operator>>(std::istream& in, String& string){
+std::istream& getline(std::istream& in, String& string, char delimiter = '\n') {
     string.clear();
-    while (isspace(in.peek())) in.get();
-    for (char c; !isspace(in.peek()) && in >> c;){
-        string += c;
+    std::istream::sentry sentry(in, true);
+    if (!sentry) return in;
+
+    std::streambuf* buffer = in.rdbuf();
+    std::ios_base::iostate state = std::ios_base::goodbit;
+    bool extracted = false;
+    while (true) {
+        StringView area = StreamBufferAccess::get_area(buffer);
+        if (area.empty()) {
+            int c = buffer->sbumpc();
+            if (c == std::char_traits<char>::eof()) {
+                state |= std::ios_base::eofbit;
+                break;
+            }
+            extracted = true;
+            if (c == static_cast<unsigned char>(delimiter)) break;
+            string.push_back(c);
+            continue;
+        }
+
+        extracted = true;
+        const void* found = memchr(area.data(), delimiter, area.length());
+        if (found == nullptr) {
+            string += area;
+            StreamBufferAccess::skip(buffer, area.length());
+            continue;
+        }
+        size_t count = static_cast<const char*>(found) - area.data();
+        string += area.substr(0, count);
+        StreamBufferAccess::skip(buffer, count + 1);
+        break;
+    }
+    if (!extracted) {
+        state |= std::ios_base::failbit;
     }
+    in.setstate(state);
     return in;
 }
 
 std::ostream& operator<<(std::ostream& out, const String& string) {
-    for (size_t i = 0; i < string.length(); ++i) {
-        out << string[i];
-    }
-    return out;
+    return out.write(string.data(), string.length());
+}
+
+inline std::ostream& operator<<(std::ostream& out, StringView view) {
+    return out.write(view.data(), view.length());
 }
 
-String operator+(String string1, const String& string2) {
+String operator+(String string1, StringView string2) {
     string1 += string2;
     return string1;
 }
@@ -225,10 +822,914 @@ String operator+(String string1, char c) {
     return string1;
 }
 
-String operator+(char c, const String& string1) {
+String operator+(char c, StringView string1) {
     String new_string;
     new_string += c;
     new_string += string1;
     return new_string;
 }
 
+
+
+// A delimiter reports where its next occurrence in the text starts and how
+// long it is, or text.length() when there is none. Delimiters that skip
+// empty fields behave like whitespace: runs of them separate one field.
+struct CharDelimiter {
+    static const bool SKIP_EMPTY = false;
+
+    size_t find(StringView text, size_t& length) const {
+        length = 1;
+        const void* found = memchr(text.data(), symbol, text.length());
+        return found ? static_cast<const char*>(found) - text.data()
+                     : text.length();
+    }
+
+    char symbol;
+};
+
+struct StringDelimiter {
+    static const bool SKIP_EMPTY = false;
+
+    size_t find(StringView text, size_t& length) const {
+        length = separator.length();
+        return separator.empty() ? text.length() : text.find(separator);
+    }
+
+    StringView separator;
+};
+
+struct WhitespaceDelimiter {
+    static const bool SKIP_EMPTY = true;
+
+    size_t find(StringView text, size_t& length) const {
+        length = 1;
+        size_t i = 0;
+#if defined(__SSE2__)
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i controls = _mm_set1_epi8('\r' - '\t');
+        for (; i + sizeof(__m128i) <= text.length(); i += sizeof(__m128i)) {
+            __m128i block = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(text.data() + i));
+            __m128i shifted = _mm_sub_epi8(block, tab);
+            __m128i is_control = _mm_cmpeq_epi8(
+                _mm_min_epu8(shifted, controls), shifted);
+            uint32_t mask = _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(block, space), is_control));
+            if (mask) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+#endif
+        while (i < text.length() && !is_ascii_space(text[i])) ++i;
+        return i;
+    }
+};
+
+template <typename Delimiter>
+class SplitRange {
+public:
+    class iterator {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = StringView;
+        using pointer = const StringView*;
+        using reference = const StringView&;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator(): _finished(true), _at_end(true) {}
+
+        iterator(StringView text, Delimiter delimiter)
+            : _rest(text), _delimiter(delimiter) {
+            advance();
+        }
+
+        const StringView& operator*() const {
+            return _field;
+        }
+
+        const StringView* operator->() const {
+            return &_field;
+        }
+
+        iterator& operator++() {
+            advance();
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator it = *this;
+            advance();
+            return it;
+        }
+
+        bool operator==(const iterator& rhs) const {
+            if (_at_end || rhs._at_end) return _at_end == rhs._at_end;
+            return _field.data() == rhs._field.data() &&
+                   _field.length() == rhs._field.length();
+        }
+
+        bool operator!=(const iterator& rhs) const {
+            return !(*this == rhs);
+        }
+
+    private:
+        void advance() {
+            do {
+                if (_finished) {
+                    _at_end = true;
+                    return;
+                }
+                size_t length = 0;
+                size_t index = _delimiter.find(_rest, length);
+                if (index == _rest.length()) {
+                    _field = _rest;
+                    _finished = true;
+                } else {
+                    _field = _rest.substr(0, index);
+                    _rest.remove_prefix(index + length);
+                }
+            } while (Delimiter::SKIP_EMPTY && _field.empty());
+        }
+
+        StringView _rest;
+        StringView _field;
+        Delimiter _delimiter{};
+        bool _finished = false;
+        bool _at_end = false;
+    };
+
+    SplitRange(StringView text, Delimiter delimiter)
+        : _text(text), _delimiter(delimiter) {}
+
+    iterator begin() const {
+        return iterator(_text, _delimiter);
+    }
+
+    iterator end() const {
+        return iterator();
+    }
+
+private:
+    StringView _text;
+    Delimiter _delimiter;
+};
+
+
+
+inline SplitRange<CharDelimiter> StringView::split(char delimiter) const {
+    return SplitRange<CharDelimiter>(*this, CharDelimiter{delimiter});
+}
+
+inline SplitRange<StringDelimiter> StringView::split(StringView delimiter) const {
+    return SplitRange<StringDelimiter>(*this, StringDelimiter{delimiter});
+}
+
+inline SplitRange<WhitespaceDelimiter> StringView::tokenize() const {
+    return SplitRange<WhitespaceDelimiter>(*this, WhitespaceDelimiter{});
+}
+
+SplitRange<CharDelimiter> String::split(char delimiter) const {
+    return StringView(*this).split(delimiter);
+}
+
+SplitRange<StringDelimiter> String::split(StringView delimiter) const {
+    return StringView(*this).split(delimiter);
+}
+
+SplitRange<WhitespaceDelimiter> String::tokenize() const {
+    return StringView(*this).tokenize();
+}
+
+
+
+
+class AhoCorasick {
+public:
+    struct Match {
+        size_t position;
+        size_t pattern;
+    };
+
+    explicit AhoCorasick(const std::vector<String>& patterns);
+
+    size_t patterns_count() const;
+    std::vector<Match> find_all(StringView text) const;
+
+    template <typename Callback>
+    void scan(StringView text, Callback callback) const;
+
+private:
+    static constexpr uint32_t NONE = static_cast<uint32_t>(-1);
+
+    void build_trie(const std::vector<String>& patterns);
+    void build_links();
+    uint32_t& transition(uint32_t state, size_t symbol_class);
+
+    // Bytes that never occur in a pattern share class 0, so a row of the
+    // transition table is only as wide as the patterns' own alphabet.
+    size_t _classes[256] = {};
+    size_t _alphabet_size = 1;
+    std::vector<uint32_t> _transitions;
+    std::vector<uint32_t> _output;
+    std::vector<uint32_t> _dictionary;
+    std::vector<uint32_t> _dictionary_next;
+    std::vector<uint32_t> _next_pattern;
+    std::vector<size_t> _lengths;
+};
+
+
+
+AhoCorasick::AhoCorasick(const std::vector<String>& patterns) {
+    for (const String& pattern : patterns) {
+        for (size_t i = 0; i < pattern.length(); ++i) {
+            size_t& symbol_class = _classes[static_cast<unsigned char>(pattern[i])];
+            if (symbol_class == 0) {
+                symbol_class = _alphabet_size++;
+            }
+        }
+    }
+    build_trie(patterns);
+    build_links();
+}
+
+size_t AhoCorasick::patterns_count() const {
+    return _lengths.size();
+}
+
+std::vector<AhoCorasick::Match> AhoCorasick::find_all(StringView text) const {
+    std::vector<Match> matches;
+    scan(text, [&matches](const Match& match) {
+        matches.push_back(match);
+    });
+    return matches;
+}
+
+template <typename Callback>
+void AhoCorasick::scan(StringView text, Callback callback) const {
+    uint32_t state = 0;
+    for (size_t i = 0; i < text.length(); ++i) {
+        state = _transitions[state * _alphabet_size +
+                             _classes[static_cast<unsigned char>(text[i])]];
+        for (uint32_t found = _dictionary[state]; found != NONE;
+             found = _dictionary_next[found]) {
+            for (uint32_t pattern = _output[found]; pattern != NONE;
+                 pattern = _next_pattern[pattern]) {
+                callback(Match{i + 1 - _lengths[pattern], pattern});
+            }
+        }
+    }
+}
+
+void AhoCorasick::build_trie(const std::vector<String>& patterns) {
+    _transitions.assign(_alphabet_size, NONE);
+    _output.push_back(NONE);
+    _next_pattern.assign(patterns.size(), NONE);
+    _lengths.resize(patterns.size());
+
+    for (size_t index = 0; index < patterns.size(); ++index) {
+        const String& pattern = patterns[index];
+        _lengths[index] = pattern.length();
+        if (pattern.empty()) continue;
+
+        uint32_t state = 0;
+        for (size_t i = 0; i < pattern.length(); ++i) {
+            size_t symbol_class = _classes[static_cast<unsigned char>(pattern[i])];
+            if (transition(state, symbol_class) == NONE) {
+                uint32_t new_state = _output.size();
+                transition(state, symbol_class) = new_state;
+                _transitions.resize(_transitions.size() + _alphabet_size, NONE);
+                _output.push_back(NONE);
+            }
+            state = transition(state, symbol_class);
+        }
+        _next_pattern[index] = _output[state];
+        _output[state] = index;
+    }
+}
+
+// Breadth-first pass that turns the trie into a full DFA: missing edges are
+// borrowed from the failure state, and every state gets a link to the nearest
+// state on its suffix chain that ends some pattern.
+void AhoCorasick::build_links() {
+    size_t states_count = _output.size();
+    std::vector<uint32_t> fail(states_count, 0);
+    _dictionary.assign(states_count, NONE);
+    _dictionary_next.assign(states_count, NONE);
+
+    std::vector<uint32_t> queue;
+    queue.reserve(states_count);
+    for (size_t symbol_class = 0; symbol_class < _alphabet_size; ++symbol_class) {
+        uint32_t& next = transition(0, symbol_class);
+        if (next == NONE) {
+            next = 0;
+        } else {
+            queue.push_back(next);
+        }
+    }
+
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t state = queue[head];
+        uint32_t link = fail[state];
+        _dictionary[state] = _output[state] != NONE ? state : _dictionary[link];
+        if (_dictionary[state] == state) {
+            _dictionary_next[state] = _dictionary[link];
+        }
+        for (size_t symbol_class = 0; symbol_class < _alphabet_size; ++symbol_class) {
+            uint32_t& next = transition(state, symbol_class);
+            if (next == NONE) {
+                next = transition(link, symbol_class);
+            } else {
+                fail[next] = transition(link, symbol_class);
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+uint32_t& AhoCorasick::transition(uint32_t state, size_t symbol_class) {
+    return _transitions[state * _alphabet_size + symbol_class];
+}
+
+
+
+class Rope {
+private:
+    struct Node;
+    struct ChunkCursor;
+
+public:
+    class const_iterator;
+
+    Rope();
+    explicit Rope(StringView);
+    Rope(const Rope&);
+    Rope(Rope&&);
+    ~Rope();
+    Rope& operator=(const Rope&);
+    Rope& operator=(Rope&&);
+
+    size_t length() const;
+    bool empty() const;
+    void clear();
+
+    void insert(size_t, StringView);
+    void erase(size_t, size_t);
+    size_t find(StringView) const;
+    size_t find(StringView, size_t) const;
+    String to_string() const;
+
+    template <typename Callback>
+    void for_each_chunk(Callback callback) const;
+
+    char operator[](size_t) const;
+    Rope& operator+=(StringView);
+    Rope& operator+=(Rope&&);
+    Rope& operator+=(const Rope&);
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+private:
+    // Text inserted in one piece is cut into chunks of at most this length,
+    // and short insertions are glued onto a neighbouring chunk while it fits.
+    static const size_t CHUNK_LENGTH = 1024;
+
+    struct Node {
+        Node(StringView text, uint32_t key): chunk(text), size(text.length()),
+                                             priority(key) {}
+
+        String chunk;
+        size_t size;
+        uint32_t priority;
+        Node* left = nullptr;
+        Node* right = nullptr;
+    };
+
+    struct NodeDeleter {
+        void operator()(Node* node) const {
+            destroy(node);
+        }
+    };
+
+    // Owns a subtree while it is being built, so a throwing allocation
+    // frees the nodes made so far.
+    using NodeOwner = std::unique_ptr<Node, NodeDeleter>;
+
+    struct ChunkCursor {
+        explicit ChunkCursor(const Node* root);
+        void next();
+
+        std::vector<const Node*> stack;
+        const Node* node = nullptr;
+    };
+
+    static size_t size(const Node*);
+    static void update(Node*);
+    static Node* merge(Node*, Node*);
+    static Node* copy(const Node*);
+    static void destroy(Node*);
+    void split(Node*, size_t, Node*&, Node*&);
+    Node* build(StringView);
+    bool append_to_last(Node*, StringView);
+    uint32_t random_priority();
+
+    uint32_t _seed = 2463534242u;
+    Node* _root = nullptr;
+};
+
+class Rope::const_iterator {
+public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = char;
+    using pointer = const char*;
+    using reference = const char&;
+    using iterator_category = std::forward_iterator_tag;
+
+    const_iterator(): _cursor(nullptr) {}
+    explicit const_iterator(const Node* root): _cursor(root) {}
+
+    const char& operator*() const {
+        return _cursor.node->chunk.data()[_index];
+    }
+
+    const_iterator& operator++() {
+        if (++_index == _cursor.node->chunk.length()) {
+            _cursor.next();
+            _index = 0;
+        }
+        return *this;
+    }
+
+    const_iterator operator++(int) {
+        const_iterator it = *this;
+        ++*this;
+        return it;
+    }
+
+    bool operator==(const const_iterator& rhs) const {
+        return _cursor.node == rhs._cursor.node && _index == rhs._index;
+    }
+
+    bool operator!=(const const_iterator& rhs) const {
+        return !(*this == rhs);
+    }
+
+private:
+    ChunkCursor _cursor;
+    size_t _index = 0;
+};
+
+
+
+Rope::Rope() {}
+
+Rope::Rope(StringView text): _root(build(text)) {}
+
+Rope::Rope(const Rope& other): _seed(other._seed), _root(copy(other._root)) {}
+
+Rope::Rope(Rope&& other): _seed(other._seed), _root(other._root) {
+    other._root = nullptr;
+}
+
+Rope::~Rope() {
+    destroy(_root);
+}
+
+Rope& Rope::operator=(const Rope& other) {
+    if (this != &other) {
+        Node* new_root = copy(other._root);
+        destroy(_root);
+        _root = new_root;
+    }
+    return *this;
+}
+
+Rope& Rope::operator=(Rope&& other) {
+    std::swap(_root, other._root);
+    return *this;
+}
+
+
+
+size_t Rope::length() const {
+    return size(_root);
+}
+
+bool Rope::empty() const {
+    return _root == nullptr;
+}
+
+void Rope::clear() {
+    destroy(_root);
+    _root = nullptr;
+}
+
+void Rope::insert(size_t pos, StringView text) {
+    if (text.empty()) return;
+    Node* left;
+    Node* right;
+    split(_root, pos, left, right);
+    if (!append_to_last(left, text)) {
+        Node* inserted;
+        try {
+            inserted = build(text);
+        } catch (...) {
+            _root = merge(left, right);
+            throw;
+        }
+        left = merge(left, inserted);
+    }
+    _root = merge(left, right);
+}
+
+void Rope::erase(size_t pos, size_t count) {
+    Node* left;
+    Node* middle;
+    Node* right;
+    split(_root, pos, left, right);
+    try {
+        split(right, count, middle, right);
+    } catch (...) {
+        _root = merge(left, right);
+        throw;
+    }
+    destroy(middle);
+    _root = merge(left, right);
+}
+
+size_t Rope::find(StringView pattern) const {
+    return find(pattern, 0);
+}
+
+// Matches inside one chunk are left to String::find. The ones crossing a
+// chunk border are looked for in a small window made of the last
+// pattern.length() - 1 characters seen so far and the head of the next chunk.
+size_t Rope::find(StringView pattern, size_t pos) const {
+    size_t text_size = length();
+    if (pattern.empty()) return std::min(pos, text_size);
+
+    size_t tail_length = pattern.length() - 1;
+    String carry;
+    size_t carry_start = 0;
+    size_t offset = 0;
+    for (ChunkCursor cursor(_root); cursor.node != nullptr; cursor.next()) {
+        const String& chunk = cursor.node->chunk;
+        size_t chunk_end = offset + chunk.length();
+        if (chunk_end + tail_length <= pos) {
+            offset = chunk_end;
+            continue;
+        }
+
+        if (!carry.empty()) {
+            String window = carry;
+            window += chunk.view(0, tail_length);
+            size_t from = pos > carry_start ? pos - carry_start : 0;
+            size_t index = window.find(pattern, from);
+            if (index < carry.length()) return carry_start + index;
+        }
+
+        size_t index = chunk.find(pattern, pos > offset ? pos - offset : 0);
+        if (index != chunk.length()) return offset + index;
+
+        if (chunk.length() >= tail_length) {
+            carry = chunk.substr(chunk.length() - tail_length, tail_length);
+            carry_start = chunk_end - tail_length;
+        } else {
+            carry += chunk;
+            size_t extra = carry.length() > tail_length
+                         ? carry.length() - tail_length : 0;
+            carry = carry.substr(extra, tail_length);
+            carry_start = chunk_end - carry.length();
+        }
+        offset = chunk_end;
+    }
+    return text_size;
+}
+
+String Rope::to_string() const {
+    String text;
+    for_each_chunk([&text](StringView chunk) {
+        text += chunk;
+    });
+    return text;
+}
+
+template <typename Callback>
+void Rope::for_each_chunk(Callback callback) const {
+    for (ChunkCursor cursor(_root); cursor.node != nullptr; cursor.next()) {
+        callback(StringView(cursor.node->chunk));
+    }
+}
+
+
+
+char Rope::operator[](size_t index) const {
+    const Node* node = _root;
+    while (true) {
+        size_t left_size = size(node->left);
+        if (index < left_size) {
+            node = node->left;
+        } else if (index < left_size + node->chunk.length()) {
+            return node->chunk[index - left_size];
+        } else {
+            index -= left_size + node->chunk.length();
+            node = node->right;
+        }
+    }
+}
+
+Rope& Rope::operator+=(StringView text) {
+    insert(length(), text);
+    return *this;
+}
+
+Rope& Rope::operator+=(Rope&& other) {
+    _root = merge(_root, other._root);
+    other._root = nullptr;
+    return *this;
+}
+
+Rope& Rope::operator+=(const Rope& other) {
+    return *this += Rope(other);
+}
+
+Rope::const_iterator Rope::begin() const {
+    return const_iterator(_root);
+}
+
+Rope::const_iterator Rope::end() const {
+    return const_iterator();
+}
+
+
+
+Rope::ChunkCursor::ChunkCursor(const Node* root) {
+    for (; root != nullptr; root = root->left) {
+        stack.push_back(root);
+    }
+    next();
+}
+
+void Rope::ChunkCursor::next() {
+    if (stack.empty()) {
+        node = nullptr;
+        return;
+    }
+    node = stack.back();
+    stack.pop_back();
+    for (const Node* child = node->right; child != nullptr; child = child->left) {
+        stack.push_back(child);
+    }
+}
+
+size_t Rope::size(const Node* node) {
+    return node ? node->size : 0;
+}
+
+void Rope::update(Node* node) {
+    node->size = size(node->left) + node->chunk.length() + size(node->right);
+}
+
+Rope::Node* Rope::merge(Node* left, Node* right) {
+    if (!left) return right;
+    if (!right) return left;
+    if (left->priority >= right->priority) {
+        left->right = merge(left->right, right);
+        update(left);
+        return left;
+    }
+    right->left = merge(left, right->left);
+    update(right);
+    return right;
+}
+
+// A split that falls inside a chunk cuts it in two, and the tail becomes a
+// node of its own in front of the chunk's right subtree. The cut is the only
+// step that allocates and it happens before any link changes, so a throw
+// leaves the tree as it was.
+void Rope::split(Node* node, size_t pos, Node*& left, Node*& right) {
+    if (!node) {
+        left = right = nullptr;
+        return;
+    }
+    size_t left_size = size(node->left);
+    size_t chunk_end = left_size + node->chunk.length();
+    if (pos <= left_size) {
+        split(node->left, pos, left, node->left);
+        right = node;
+    } else if (pos >= chunk_end) {
+        split(node->right, pos - chunk_end, node->right, right);
+        left = node;
+    } else {
+        size_t offset = pos - left_size;
+        NodeOwner tail(new Node(node->chunk.view(offset, node->chunk.length()),
+                                random_priority()));
+        node->chunk = node->chunk.substr(0, offset);
+        right = merge(tail.release(), node->right);
+        node->right = nullptr;
+        left = node;
+    }
+    update(node);
+}
+
+Rope::Node* Rope::build(StringView text) {
+    NodeOwner root;
+    for (size_t start = 0; start < text.length(); start += CHUNK_LENGTH) {
+        Node* chunk = new Node(text.substr(start, CHUNK_LENGTH), random_priority());
+        root.reset(merge(root.release(), chunk));
+    }
+    return root.release();
+}
+
+bool Rope::append_to_last(Node* node, StringView text) {
+    if (!node) return false;
+    bool appended = node->right
+                  ? append_to_last(node->right, text)
+                  : node->chunk.length() + text.length() <= CHUNK_LENGTH;
+    if (appended) {
+        if (!node->right) {
+            node->chunk += text;
+        }
+        node->size += text.length();
+    }
+    return appended;
+}
+
+Rope::Node* Rope::copy(const Node* node) {
+    if (!node) return nullptr;
+    NodeOwner new_node(new Node(node->chunk, node->priority));
+    new_node->size = node->size;
+    new_node->left = copy(node->left);
+    new_node->right = copy(node->right);
+    return new_node.release();
+}
+
+void Rope::destroy(Node* node) {
+    if (!node) return;
+    destroy(node->left);
+    destroy(node->right);
+    delete node;
+}
+
+uint32_t Rope::random_priority() {
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return _seed;
+}
+
+std::ostream& operator<<(std::ostream& out, const Rope& rope) {
+    rope.for_each_chunk([&out](StringView chunk) {
+        out << chunk;
+    });
+    return out;
+}
+
+
+
+class StringPool {
+public:
+    struct Symbol {
+        uint32_t id;
+
+        bool operator==(const Symbol&) const = default;
+        auto operator<=>(const Symbol&) const = default;
+    };
+
+    StringPool();
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+    ~StringPool();
+
+    Symbol intern(StringView);
+    bool contains(StringView) const;
+    StringView view(Symbol) const;
+    size_t size() const;
+
+private:
+    static constexpr uint32_t EMPTY = static_cast<uint32_t>(-1);
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    static uint64_t hash(StringView);
+    size_t lookup(StringView, uint64_t) const;
+    void grow_table();
+    const char* store(StringView);
+
+    std::vector<StringView> _strings;
+    std::vector<uint64_t> _hashes;
+    std::vector<uint32_t> _table;
+    std::vector<char*> _blocks;
+    char* _block_pointer = nullptr;
+    size_t _block_left = 0;
+};
+
+
+
+StringPool::StringPool(): _table(16, EMPTY) {}
+
+StringPool::~StringPool() {
+    for (char* block : _blocks) {
+        delete[] block;
+    }
+}
+
+StringPool::Symbol StringPool::intern(StringView text) {
+    uint64_t text_hash = hash(text);
+    size_t slot = lookup(text, text_hash);
+    if (_table[slot] != EMPTY) {
+        return Symbol{_table[slot]};
+    }
+
+    uint32_t id = _strings.size();
+    _strings.push_back(StringView(store(text), text.length()));
+    _hashes.push_back(text_hash);
+    _table[slot] = id;
+    if (_strings.size() * 2 > _table.size()) {
+        grow_table();
+    }
+    return Symbol{id};
+}
+
+bool StringPool::contains(StringView text) const {
+    return _table[lookup(text, hash(text))] != EMPTY;
+}
+
+StringView StringPool::view(Symbol symbol) const {
+    return _strings[symbol.id];
+}
+
+size_t StringPool::size() const {
+    return _strings.size();
+}
+
+
+
+// Mixes the text a machine word at a time; the stored full hashes let the
+// probe loop skip almost every memcmp and make rehashing free of rereads.
+uint64_t StringPool::hash(StringView text) {
+    const uint64_t multiplier = 0xff51afd7ed558ccdull;
+    uint64_t result = 0x9e3779b97f4a7c15ull ^ text.length();
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= text.length(); i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, text.data() + i, sizeof(uint64_t));
+        result = (result ^ word) * multiplier;
+        result ^= result >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, text.data() + i, text.length() - i);
+    result = (result ^ tail) * multiplier;
+    return result ^ (result >> 29);
+}
+
+size_t StringPool::lookup(StringView text, uint64_t text_hash) const {
+    size_t mask = _table.size() - 1;
+    for (size_t slot = text_hash & mask;; slot = (slot + 1) & mask) {
+        uint32_t id = _table[slot];
+        if (id == EMPTY || (_hashes[id] == text_hash && _strings[id] == text)) {
+            return slot;
+        }
+    }
+}
+
+void StringPool::grow_table() {
+    std::vector<uint32_t> new_table(_table.size() * 2, EMPTY);
+    size_t mask = new_table.size() - 1;
+    for (uint32_t id = 0; id < _strings.size(); ++id) {
+        size_t slot = _hashes[id] & mask;
+        while (new_table[slot] != EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+        new_table[slot] = id;
+    }
+    _table.swap(new_table);
+}
+
+// The empty string needs no bytes, and a fresh pool has no block to point
+// into yet.
+const char* StringPool::store(StringView text) {
+    if (text.empty()) {
+        return "";
+    }
+    if (text.length() > _block_left) {
+        size_t block_size = std::max(BLOCK_SIZE, text.length());
+        _blocks.push_back(new char[block_size]);
+        _block_pointer = _blocks.back();
+        _block_left = block_size;
+    }
+    char* pointer = _block_pointer;
+    memcpy(pointer, text.data(), text.length());
+    _block_pointer += text.length();
+    _block_left -= text.length();
+    return pointer;
+}
+
+
+
+template <>
+struct std::hash<StringPool::Symbol> {
+    size_t operator()(StringPool::Symbol symbol) const {
+        return symbol.id;
+    }
+};